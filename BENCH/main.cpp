@@ -0,0 +1,374 @@
+#include "../INTERPRETER/Interpreter.h"
+#include "../INTERPRETER/JitCompiler.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef MINDBOGGLER_CORPUS_DIR
+#define MINDBOGGLER_CORPUS_DIR "BENCH/corpus"
+#endif
+
+namespace {
+
+struct Program {
+    const char* name;
+    const char* source;
+};
+
+// Small enough to stay in the binary, heavy enough that timer resolution and start-up
+// don't dominate. Every entry finishes in well under a second on the fast engines.
+const Program corpus[] = {
+    {"hello", "++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.+++++++..+++.>>.<-.<.+++.------.--------.>>+.>++."},
+    {"nested", "-[>-[>-[>+>[]<<-]<-]<-]"},
+    {"countdown", "-[>-[>-[>++++<-]<-]<-]>>>[-]"},
+    {"idioms", "-[>-[>-[->+>+<<]>>[-<<+>>]<<<-]<-]"},
+    {"walk", "-[>-[>+>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>+<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<-]<-]"},
+};
+
+// The on-disk workload set (see "Benchmark Corpus" in README.md). Each NAME.b has its expected
+// output in NAME.out; the programs are pure command characters so mindboggler-run takes them as-is.
+struct CorpusFile {
+    const char* name;
+    CellWidth cellWidth;
+};
+
+const CorpusFile corpusFiles[] = {
+    {"mandelbrot", CellWidth::BITS_16},
+    {"factor", CellWidth::BITS_16},
+    {"nested", CellWidth::BITS_8},
+    {"fib", CellWidth::BITS_8},
+    {"hanoi", CellWidth::BITS_8},
+};
+
+struct Engine {
+    const char* name;
+    // Corpus runs compare the runProgramFast() engines on complete runs. step() only gets
+    // a slice of each program and the interruptible loop counts steps in an int.
+    bool corpus;
+    std::function<bool()> available;
+    // Runs the loaded program and returns the ops it executed.
+    std::function<long long(Interpreter&)> run;
+};
+
+const int stepLimit = 20000000;
+
+std::vector<Engine> engines() {
+    auto always = [] { return true; };
+    auto fast = [](DispatchMode mode) {
+        return [mode](Interpreter& interp) {
+            interp.setDispatchMode(mode);
+            return interp.runProgramFast(LLONG_MAX);
+        };
+    };
+    return {
+        // step() walks the source one character at a time and never finishes the heavy
+        // entries in reasonable time, so it only gets a fixed slice of each.
+        {"step", false, always, [](Interpreter& interp) {
+            return static_cast<long long>(interp.runUntilEnd(stepLimit));
+        }},
+        {"switch", true, always, fast(DispatchMode::SWITCH)},
+        {"threaded", true, always, fast(DispatchMode::THREADED)},
+        {"jit", true, &JitCompiler::isSupported, fast(DispatchMode::JIT)},
+        {"c-module", true, &JitCompiler::canLoadModules, fast(DispatchMode::C_MODULE)},
+        // The GUI's fast mode: threaded dispatch in 50000-step chunks.
+        {"interruptible", false, always, [](Interpreter& interp) {
+            interp.setDispatchMode(DispatchMode::THREADED);
+            while (interp.runProgramFastInterruptible(50000, INT_MAX)) {
+            }
+            return static_cast<long long>(interp.getFastSteps());
+        }},
+    };
+}
+
+struct Summary {
+    std::string program;
+    std::string engine;
+    int level;
+    long long ops;
+    bool outputMatches;
+    int runs;
+    double median;
+    double p95;
+    double mean;
+    double variance;
+    double min;
+};
+
+// Times are in milliseconds; p95 is nearest-rank and the variance is the sample variance.
+Summary summarize(std::vector<double> times) {
+    Summary summary{};
+    std::sort(times.begin(), times.end());
+    size_t n = times.size();
+    summary.runs = static_cast<int>(n);
+    summary.min = times.front();
+    summary.median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+    summary.p95 = times[static_cast<size_t>(std::ceil(0.95 * n)) - 1];
+    for (double t : times) {
+        summary.mean += t / n;
+    }
+    for (double t : times) {
+        summary.variance += n > 1 ? (t - summary.mean) * (t - summary.mean) / (n - 1) : 0;
+    }
+    return summary;
+}
+
+void writeJson(std::ostream& out, const std::vector<Summary>& results) {
+    out << "{\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Summary& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"program\": \"" << r.program << "\", \"engine\": \"" << r.engine
+            << "\", \"level\": " << r.level << ", \"ops\": " << r.ops
+            << ", \"output_ok\": " << (r.outputMatches ? "true" : "false") << ", \"runs\": " << r.runs
+            << std::fixed << std::setprecision(4)
+            << ", \"median_ms\": " << r.median << ", \"p95_ms\": " << r.p95 << ", \"mean_ms\": " << r.mean
+            << ", \"variance_ms2\": " << r.variance << ", \"min_ms\": " << r.min << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void writeCsv(std::ostream& out, const std::vector<Summary>& results) {
+    out << "program,engine,level,ops,output_ok,runs,median_ms,p95_ms,mean_ms,variance_ms2,min_ms\n";
+    for (const Summary& r : results) {
+        out << r.program << "," << r.engine << "," << r.level << "," << r.ops << "," << (r.outputMatches ? 1 : 0)
+            << "," << r.runs << std::fixed << std::setprecision(4) << "," << r.median << "," << r.p95 << ","
+            << r.mean << "," << r.variance << "," << r.min << "\n";
+    }
+}
+
+bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+struct CorpusOptions {
+    std::string dir = MINDBOGGLER_CORPUS_DIR;
+    std::vector<int> levels = {static_cast<int>(OptimizationLevel::IDIOMS)};
+    std::string format = "json";
+    std::string outputPath;
+};
+
+// Runs every corpus program on every corpus engine at each requested optimization
+// level: one unrecorded warm-up, then `runs` timed runs. Returns 1 if any output differs
+// from the expected file, so a CI job can gate on it.
+int runCorpus(const CorpusOptions& options, int runs, const std::string& onlyProgram, const std::string& onlyEngine) {
+    std::vector<Summary> results;
+    bool failed = false;
+
+    for (const CorpusFile& file : corpusFiles) {
+        if (!onlyProgram.empty() && onlyProgram != file.name) {
+            continue;
+        }
+        std::string source;
+        std::string expected;
+        std::string base = options.dir + "/" + file.name;
+        if (!readFile(base + ".b", source) || !readFile(base + ".out", expected)) {
+            std::cerr << "mindboggler_bench: cannot read " << base << ".b and " << base << ".out\n";
+            return 1;
+        }
+
+        for (const Engine& engine : engines()) {
+            if (!engine.corpus || (!onlyEngine.empty() && onlyEngine != engine.name) || !engine.available()) {
+                continue;
+            }
+            for (int level : options.levels) {
+                std::vector<double> times;
+                long long ops = 0;
+                bool matches = true;
+                for (int run = 0; run <= runs; ++run) {
+                    Interpreter interp;
+                    interp.configure(PointerBehavior::CLAMP, CellBehavior::WRAP, file.cellWidth);
+                    interp.setOptimizationLevel(static_cast<OptimizationLevel>(level));
+                    interp.loadProgram(source);
+                    auto start = std::chrono::steady_clock::now();
+                    ops = engine.run(interp);
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    matches = matches && interp.getOutputBuffer() == expected;
+                    if (run > 0) {
+                        times.push_back(seconds * 1e3);
+                    }
+                }
+
+                Summary summary = summarize(times);
+                summary.program = file.name;
+                summary.engine = engine.name;
+                summary.level = level;
+                summary.ops = ops;
+                summary.outputMatches = matches;
+                results.push_back(summary);
+                failed = failed || !matches;
+
+                std::cerr << std::left << std::setw(12) << file.name << std::setw(15) << engine.name << "O" << level
+                          << std::right << std::fixed << std::setprecision(3) << std::setw(12) << summary.median
+                          << " ms median" << (matches ? "" : "  OUTPUT MISMATCH") << "\n";
+            }
+        }
+    }
+
+    std::ofstream file;
+    if (!options.outputPath.empty()) {
+        file.open(options.outputPath, std::ios::binary);
+        if (!file) {
+            std::cerr << "mindboggler_bench: cannot write " << options.outputPath << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = options.outputPath.empty() ? std::cout : file;
+    if (options.format == "csv") {
+        writeCsv(out, results);
+    } else {
+        writeJson(out, results);
+    }
+    return failed ? 1 : 0;
+}
+
+bool parseLevels(const std::string& text, std::vector<int>& levels) {
+    levels.clear();
+    if (text == "all") {
+        levels = {0, 1, 2};
+        return true;
+    }
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item != "0" && item != "1" && item != "2") {
+            return false;
+        }
+        levels.push_back(item[0] - '0');
+    }
+    return !levels.empty();
+}
+
+void printUsage() {
+    std::cout << "Usage: mindboggler_bench [--repeat N] [--program NAME] [--engine NAME]\n"
+                 "       mindboggler_bench --corpus [--corpus-dir DIR] [--repeat N] [--levels LIST]\n"
+                 "                         [--format json|csv] [--output FILE] [--program NAME] [--engine NAME]\n"
+                 "\n"
+                 "Times every engine on the built-in corpus and reports the best of N runs.\n"
+                 "Ops are compiled instructions for the fast engines and source characters for step.\n"
+                 "\n"
+                 "With --corpus, runs the programs in BENCH/corpus instead, checks each output\n"
+                 "against its .out file and writes median, p95, mean and variance per program,\n"
+                 "engine and optimization level. LIST is a comma-separated subset of 0 (none),\n"
+                 "1 (fold) and 2 (idioms, the default), or \"all\". Exits with 1 on a wrong output.\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int repeat = 5;
+    std::string onlyProgram;
+    std::string onlyEngine;
+    bool corpusMode = false;
+    CorpusOptions corpusOptions;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "--repeat" || arg == "-r") && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if ((arg == "--program" || arg == "-p") && i + 1 < argc) {
+            onlyProgram = argv[++i];
+        } else if ((arg == "--engine" || arg == "-e") && i + 1 < argc) {
+            onlyEngine = argv[++i];
+        } else if (arg == "--corpus") {
+            corpusMode = true;
+        } else if (arg == "--corpus-dir" && i + 1 < argc) {
+            corpusOptions.dir = argv[++i];
+        } else if (arg == "--levels" && i + 1 < argc && parseLevels(argv[i + 1], corpusOptions.levels)) {
+            ++i;
+        } else if (arg == "--format" && i + 1 < argc && (std::string(argv[i + 1]) == "json" || std::string(argv[i + 1]) == "csv")) {
+            corpusOptions.format = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            corpusOptions.outputPath = argv[++i];
+        } else {
+            printUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    if (corpusMode) {
+        return runCorpus(corpusOptions, repeat, onlyProgram, onlyEngine);
+    }
+
+    std::cout << std::left << std::setw(12) << "program" << std::setw(15) << "engine"
+              << std::right << std::setw(14) << "ops" << std::setw(12) << "time (ms)"
+              << std::setw(10) << "ns/op" << std::setw(14) << "Mops/sec" << "\n";
+
+    std::map<std::string, double> totals;
+    // ns/op and Mops/sec for the compiled engines divide by the switch engine's count,
+    // so every row measures the same work whatever the engine reports. step() runs its
+    // own slice of the source and keeps its own count.
+    std::map<std::string, long long> switchOps;
+    auto reference = [&](const Program& program) {
+        auto found = switchOps.find(program.name);
+        if (found == switchOps.end()) {
+            Interpreter interp;
+            interp.setDispatchMode(DispatchMode::SWITCH);
+            interp.loadProgram(program.source);
+            found = switchOps.emplace(program.name, interp.runProgramFast(LLONG_MAX)).first;
+        }
+        return found->second;
+    };
+    for (const Engine& engine : engines()) {
+        if (!onlyEngine.empty() && onlyEngine != engine.name) {
+            continue;
+        }
+        if (!engine.available()) {
+            std::cout << std::left << std::setw(12) << "-" << std::setw(15) << engine.name << "not available on this platform\n";
+            continue;
+        }
+
+        for (const Program& program : corpus) {
+            if (!onlyProgram.empty() && onlyProgram != program.name) {
+                continue;
+            }
+
+            double best = 0;
+            long long ops = 0;
+            // The first run warms caches and builds the C module; it is not counted.
+            for (int run = 0; run <= repeat; ++run) {
+                Interpreter interp;
+                interp.loadProgram(program.source);
+                auto start = std::chrono::steady_clock::now();
+                ops = engine.run(interp);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (run == 1 || (run > 1 && seconds < best)) {
+                    best = seconds;
+                }
+            }
+            totals[engine.name] += best;
+            if (std::string(engine.name) == "switch") {
+                switchOps.emplace(program.name, ops);
+            }
+            const long long work = std::string(engine.name) == "step" ? ops : reference(program);
+
+            std::cout << std::left << std::setw(12) << program.name << std::setw(15) << engine.name
+                      << std::right << std::setw(14) << ops
+                      << std::setw(12) << std::fixed << std::setprecision(3) << best * 1e3
+                      << std::setw(10) << std::setprecision(2) << (work > 0 ? best * 1e9 / work : 0.0)
+                      << std::setw(14) << std::setprecision(1) << (best > 0 ? work / best / 1e6 : 0.0) << "\n";
+        }
+    }
+
+    std::cout << "\n";
+    for (const auto& total : totals) {
+        std::cout << std::left << std::setw(15) << total.first << std::right << std::fixed << std::setprecision(3)
+                  << total.second * 1e3 << " ms total\n";
+    }
+    return 0;
+}
@@ -0,0 +1,246 @@
+#include "../INTERPRETER/Interpreter.h"
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace {
+
+struct Options {
+    std::string programPath;
+    std::string inputPath;
+    std::string outputPath;
+    std::string cacheDir;
+    std::string bytecodePath;
+    DispatchMode engine = DispatchMode::JIT;
+    PointerBehavior pointerBehavior = PointerBehavior::CLAMP;
+    CellBehavior cellBehavior = CellBehavior::WRAP;
+    CellWidth cellWidth = CellWidth::BITS_8;
+    int memorySize = 30000;
+    long long maxSteps = LLONG_MAX;
+    bool timing = false;
+};
+
+void printUsage(std::ostream& out) {
+    out << "Usage: mindboggler-run [options] program.bf\n"
+           "       mindboggler-run [options] program.bfc\n"
+           "\n"
+           "Runs a Brainfuck program, reading stdin and writing stdout. A .bfc file is run\n"
+           "as compiled, with the pointer, cell and memory settings it was saved with.\n"
+           "\n"
+           "  -e, --engine NAME     switch, threaded, jit (default) or c\n"
+           "  -p, --pointer NAME    clamp (default), wrap, error or unbounded\n"
+           "  -c, --cells NAME      wrap (default), unlimited or error\n"
+           "  -w, --cell-width N    8 (default), 16 or 32\n"
+           "  -m, --memory N        tape size in cells (default 30000)\n"
+           "  -s, --max-steps N     stop after N steps (default: no limit)\n"
+           "  -i, --input FILE      read input from FILE instead of stdin\n"
+           "  -o, --output FILE     write output to FILE instead of stdout\n"
+           "      --cache-dir DIR   keep compiled programs and built c modules in DIR\n"
+           "  -b, --bytecode FILE   save the compiled program to FILE (.bfc) instead of running it\n"
+           "  -t, --time            report steps and run time on stderr\n"
+           "  -h, --help            show this help\n";
+}
+
+template <typename T>
+bool lookup(const std::map<std::string, T>& names, const std::string& name, T& value) {
+    auto found = names.find(name);
+    if (found == names.end()) {
+        return false;
+    }
+    value = found->second;
+    return true;
+}
+
+bool parseCount(const std::string& text, long long& value) {
+    char* end = nullptr;
+    value = std::strtoll(text.c_str(), &end, 10);
+    return !text.empty() && *end == '\0' && value > 0;
+}
+
+// Returns 0 when the run should go ahead, otherwise the process exit code.
+int parseOptions(int argc, char* argv[], Options& options) {
+    static const std::map<std::string, DispatchMode> engines = {
+        {"switch", DispatchMode::SWITCH},
+        {"threaded", DispatchMode::THREADED},
+        {"jit", DispatchMode::JIT},
+        {"c", DispatchMode::C_MODULE}
+    };
+    static const std::map<std::string, PointerBehavior> pointers = {
+        {"clamp", PointerBehavior::CLAMP},
+        {"wrap", PointerBehavior::WRAP},
+        {"error", PointerBehavior::ERROR},
+        {"unbounded", PointerBehavior::UNBOUNDED}
+    };
+    static const std::map<std::string, CellBehavior> cells = {
+        {"wrap", CellBehavior::WRAP},
+        {"unlimited", CellBehavior::UNLIMITED},
+        {"error", CellBehavior::ERROR}
+    };
+    static const std::map<std::string, CellWidth> widths = {
+        {"8", CellWidth::BITS_8},
+        {"16", CellWidth::BITS_16},
+        {"32", CellWidth::BITS_32}
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printUsage(std::cout);
+            return -1;
+        }
+        if (arg == "-t" || arg == "--time") {
+            options.timing = true;
+            continue;
+        }
+        if (arg.size() > 1 && arg[0] == '-') {
+            if (i + 1 >= argc) {
+                std::cerr << "mindboggler-run: " << arg << " needs a value\n";
+                return 2;
+            }
+            std::string value = argv[++i];
+            long long count = 0;
+            bool valid = true;
+
+            if (arg == "-e" || arg == "--engine") {
+                valid = lookup(engines, value, options.engine);
+            } else if (arg == "-p" || arg == "--pointer") {
+                valid = lookup(pointers, value, options.pointerBehavior);
+            } else if (arg == "-c" || arg == "--cells") {
+                valid = lookup(cells, value, options.cellBehavior);
+            } else if (arg == "-w" || arg == "--cell-width") {
+                valid = lookup(widths, value, options.cellWidth);
+            } else if (arg == "-m" || arg == "--memory") {
+                valid = parseCount(value, count) && count <= INT_MAX;
+                options.memorySize = static_cast<int>(count);
+            } else if (arg == "-s" || arg == "--max-steps") {
+                valid = parseCount(value, count);
+                options.maxSteps = count;
+            } else if (arg == "-i" || arg == "--input") {
+                options.inputPath = value;
+            } else if (arg == "-o" || arg == "--output") {
+                options.outputPath = value;
+            } else if (arg == "--cache-dir") {
+                options.cacheDir = value;
+            } else if (arg == "-b" || arg == "--bytecode") {
+                options.bytecodePath = value;
+            } else {
+                std::cerr << "mindboggler-run: unknown option " << arg << "\n";
+                return 2;
+            }
+
+            if (!valid) {
+                std::cerr << "mindboggler-run: invalid value '" << value << "' for " << arg << "\n";
+                return 2;
+            }
+            continue;
+        }
+        if (!options.programPath.empty()) {
+            std::cerr << "mindboggler-run: only one program can be run at a time\n";
+            return 2;
+        }
+        options.programPath = arg;
+    }
+
+    if (options.programPath.empty()) {
+        printUsage(std::cerr);
+        return 2;
+    }
+    return 0;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    int status = parseOptions(argc, argv, options);
+    if (status != 0) {
+        return status < 0 ? 0 : status;
+    }
+
+    const bool compiled = options.programPath.ends_with(".bfc");
+    std::string program;
+    if (!compiled) {
+        std::ifstream file(options.programPath, std::ios::binary);
+        if (!file) {
+            std::cerr << "mindboggler-run: cannot open " << options.programPath << "\n";
+            return 1;
+        }
+        program.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        // Everything but the eight commands is a comment, newlines included.
+        std::erase_if(program, [](char c) { return std::string_view("[].,<>+-").find(c) == std::string_view::npos; });
+    }
+    const bool saving = !options.bytecodePath.empty();
+
+    std::FILE* outputFile = stdout;
+    if (!options.outputPath.empty() && !saving) {
+        outputFile = std::fopen(options.outputPath.c_str(), "wb");
+        if (!outputFile) {
+            std::cerr << "mindboggler-run: cannot write " << options.outputPath << "\n";
+            return 1;
+        }
+    }
+
+    long long steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    status = 0;
+    try {
+        Interpreter interp(options.memorySize);
+        interp.configure(options.pointerBehavior, options.cellBehavior, options.cellWidth);
+        interp.setDispatchMode(options.engine);
+        if (!options.cacheDir.empty()) {
+            interp.setNativeCacheDir(options.cacheDir);
+            interp.setCompileCacheDir(options.cacheDir);
+        }
+        if (compiled) {
+            interp.loadBytecode(options.programPath);
+        } else {
+            interp.loadProgram(program);
+        }
+
+        if (saving) {
+            interp.saveBytecode(options.bytecodePath);
+        } else {
+            if (options.inputPath.empty()) {
+                interp.setInputSource(std::make_unique<StreamInput>(stdin));
+            } else {
+                interp.setInputSource(std::make_unique<FileInput>(options.inputPath));
+            }
+            interp.setOutputSink(std::make_unique<FileOutput>(outputFile));
+
+            start = std::chrono::steady_clock::now();
+            steps = interp.runProgramFast(options.maxSteps);
+
+            if (interp.isRunning()) {
+                std::cerr << "mindboggler-run: stopped at the step limit (" << options.maxSteps << ")\n";
+                status = 3;
+            }
+        }
+    } catch (const PointerOverflowError& e) {
+        std::cerr << "mindboggler-run: pointer overflow: " << e.what() << "\n";
+        status = 1;
+    } catch (const CellOverflowError& e) {
+        std::cerr << "mindboggler-run: cell overflow: " << e.what() << "\n";
+        status = 1;
+    } catch (const std::exception& e) {
+        std::cerr << "mindboggler-run: " << e.what() << "\n";
+        status = 1;
+    }
+
+    if (outputFile != stdout) {
+        std::fclose(outputFile);
+    }
+    if (options.timing) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "steps: " << steps << "\n"
+                  << "time: " << seconds << " s\n";
+    }
+    return status;
+}
@@ -0,0 +1,275 @@
+#include "BytecodeFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MB_MMAP_FILE 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+#else
+#define MB_MMAP_FILE 0
+#endif
+
+namespace {
+
+const char bytecodeMagic[4] = {'M', 'B', 'B', 'C'};
+const uint16_t bytecodeVersion = 1;
+const uint16_t bytecodeOrder = 0x0102;
+
+// FNV-1a taken a word at a time, since byte by byte it would cost as much as the
+// compile a load saves. Only the last section may end mid-word; its tail is padded
+// with zeros.
+uint64_t checksum(uint64_t h, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, std::min<size_t>(8, size - i));
+        h ^= word;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+const uint64_t checksumSeed = 14695981039346656037ULL;
+
+// The header up to the checksum itself is covered too.
+const size_t checkedHeader = offsetof(BytecodeHeader, checksum);
+
+}
+
+BytecodeFile::BytecodeFile(const std::string& path) : data(nullptr), length(0), mapping(nullptr) {
+#if MB_MMAP_FILE
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open bytecode file " + path + ".");
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(BytecodeHeader))) {
+        length = static_cast<size_t>(info.st_size);
+        // Every page is read by the checks below anyway, so fault them in at once.
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            mapping = mapped;
+            data = static_cast<const char*>(mapped);
+        }
+    }
+    close(fd);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        throw std::runtime_error("Cannot open bytecode file " + path + ".");
+    }
+    length = static_cast<size_t>(in.tellg());
+    if (length >= sizeof(BytecodeHeader)) {
+        buffer.resize((length + 7) / 8);
+        in.seekg(0);
+        if (in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(length))) {
+            data = reinterpret_cast<const char*>(buffer.data());
+        }
+    }
+#endif
+
+    try {
+        validate(path);
+    } catch (...) {
+#if MB_MMAP_FILE
+        if (mapping) {
+            munmap(mapping, length);
+        }
+#endif
+        throw;
+    }
+}
+
+BytecodeFile::~BytecodeFile() {
+#if MB_MMAP_FILE
+    if (mapping) {
+        munmap(mapping, length);
+    }
+#endif
+}
+
+const Instruction* BytecodeFile::instructions() const {
+    return reinterpret_cast<const Instruction*>(data + sizeof(BytecodeHeader));
+}
+
+const SourceRange* BytecodeFile::sourceMap() const {
+    return reinterpret_cast<const SourceRange*>(instructions() + size());
+}
+
+std::string_view BytecodeFile::source() const {
+    return std::string_view(reinterpret_cast<const char*>(sourceMap() + size()), header().sourceLength);
+}
+
+void BytecodeFile::validate(const std::string& path) const {
+    auto fail = [&path](const std::string& why) {
+        throw std::runtime_error("Bad bytecode file " + path + ": " + why + ".");
+    };
+
+    if (!data) {
+        fail("unreadable or too short to hold a header");
+    }
+    const BytecodeHeader& h = header();
+    if (std::memcmp(h.magic, bytecodeMagic, sizeof(bytecodeMagic)) != 0) {
+        fail("not a bytecode file");
+    }
+    if (h.byteOrder != bytecodeOrder) {
+        fail("written on a machine with the other byte order");
+    }
+    if (h.version != bytecodeVersion) {
+        fail("version " + std::to_string(h.version) + ", this build reads " + std::to_string(bytecodeVersion));
+    }
+    if (h.pointerBehavior > static_cast<uint8_t>(PointerBehavior::UNBOUNDED) ||
+        h.cellBehavior > static_cast<uint8_t>(CellBehavior::ERROR) ||
+        h.cellWidth > static_cast<uint8_t>(CellWidth::BITS_32) ||
+        h.optimizationLevel > static_cast<uint8_t>(OptimizationLevel::IDIOMS) || h.memorySize <= 0) {
+        fail("unknown settings");
+    }
+    const uint64_t expected = sizeof(BytecodeHeader) +
+                              uint64_t(h.instructionCount) * (sizeof(Instruction) + sizeof(SourceRange)) +
+                              h.sourceLength;
+    if (expected != length || h.sourceLength > INT32_MAX || h.instructionCount > INT32_MAX) {
+        fail("truncated or padded");
+    }
+    uint64_t sum = checksum(checksumSeed, data, checkedHeader);
+    if (checksum(sum, data + sizeof(BytecodeHeader), length - sizeof(BytecodeHeader)) != h.checksum) {
+        fail("checksum mismatch");
+    }
+
+    // The engines follow jumps without looking, and MULTIPLY reads MUL_TERMs up to the
+    // loop end it points at. Loop heads (LOOP_START and the idiom ops) and LOOP_ENDs have
+    // to pair up like brackets, each pointing at the other: a LOOP_END points back at its
+    // LOOP_START, CLEAR or SCAN, or at the last MUL_TERM of its MULTIPLY. A SCAN that
+    // doesn't move would never end, and a MULTIPLY's first term is the loop counter's
+    // step, which the engines only know as +1 or -1.
+    const Instruction* ops = instructions();
+    const SourceRange* spans = sourceMap();
+    const int count = size();
+    const int sourceLength = static_cast<int>(h.sourceLength);
+    std::vector<int> open;
+    for (int i = 0; i < count; ++i) {
+        const Instruction& ins = ops[i];
+        bool valid = true;
+        switch (ins.op) {
+            case OpCode::LOOP_END: {
+                if (open.empty()) {
+                    valid = false;
+                    break;
+                }
+                int head = open.back();
+                open.pop_back();
+                int back = head;
+                while (ops[head].op == OpCode::MULTIPLY && ops[back + 1].op == OpCode::MUL_TERM) {
+                    back++;
+                }
+                valid = ops[head].arg == i && ins.arg == back;
+                break;
+            }
+            case OpCode::LOOP_START:
+            case OpCode::CLEAR:
+            case OpCode::SCAN:
+            case OpCode::MULTIPLY:
+                valid = ins.arg > i && ins.arg < count && ops[ins.arg].op == OpCode::LOOP_END;
+                if (ins.op == OpCode::SCAN) {
+                    valid = valid && ins.offset != 0;
+                } else if (ins.op == OpCode::MULTIPLY) {
+                    const Instruction& step = ops[i + 1];
+                    valid = valid && step.op == OpCode::MUL_TERM && step.offset == 0 &&
+                            (step.arg == 1 || step.arg == -1);
+                }
+                open.push_back(i);
+                break;
+            case OpCode::BREAK:
+                valid = ins.arg >= 0 && ins.arg < sourceLength;
+                break;
+            case OpCode::ADD:
+            case OpCode::MOVE:
+            case OpCode::OUTPUT:
+            case OpCode::INPUT:
+            case OpCode::MUL_TERM:
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if (!valid) {
+            fail("bad instruction " + std::to_string(i));
+        }
+        if (spans[i].start < 0 || spans[i].start > spans[i].end || spans[i].end > sourceLength) {
+            fail("bad source range " + std::to_string(i));
+        }
+    }
+    if (!open.empty()) {
+        fail("bad instruction " + std::to_string(open.back()));
+    }
+}
+
+void BytecodeFile::write(const std::string& path,
+                         const std::vector<Instruction>& program,
+                         const std::vector<SourceRange>& sourceMap,
+                         const std::string& source,
+                         PointerBehavior pointerBehavior,
+                         CellBehavior cellBehavior,
+                         CellWidth cellWidth,
+                         OptimizationLevel optimizationLevel,
+                         int memorySize) {
+    namespace fs = std::filesystem;
+
+    // Copied field by field so the padding byte in each instruction is written as zero.
+    std::vector<Instruction> ops(program.size());
+    std::memset(ops.data(), 0, ops.size() * sizeof(Instruction));
+    for (size_t i = 0; i < ops.size(); ++i) {
+        ops[i].op = program[i].op;
+        ops[i].offset = program[i].offset;
+        ops[i].arg = program[i].arg;
+    }
+
+    BytecodeHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, bytecodeMagic, sizeof(bytecodeMagic));
+    header.version = bytecodeVersion;
+    header.byteOrder = bytecodeOrder;
+    header.pointerBehavior = static_cast<uint8_t>(pointerBehavior);
+    header.cellBehavior = static_cast<uint8_t>(cellBehavior);
+    header.cellWidth = static_cast<uint8_t>(cellWidth);
+    header.optimizationLevel = static_cast<uint8_t>(optimizationLevel);
+    header.memorySize = memorySize;
+    header.instructionCount = static_cast<uint32_t>(ops.size());
+    header.sourceLength = static_cast<uint32_t>(source.size());
+    uint64_t sum = checksum(checksumSeed, &header, checkedHeader);
+    sum = checksum(sum, ops.data(), ops.size() * sizeof(Instruction));
+    sum = checksum(sum, sourceMap.data(), sourceMap.size() * sizeof(SourceRange));
+    header.checksum = checksum(sum, source.data(), source.size());
+
+    std::error_code error;
+    fs::path target(path);
+    if (target.has_parent_path()) {
+        fs::create_directories(target.parent_path(), error);
+    }
+    std::string partial = path + "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+
+    std::ofstream out(partial, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(ops.data()), static_cast<std::streamsize>(ops.size() * sizeof(Instruction)));
+    out.write(reinterpret_cast<const char*>(sourceMap.data()), static_cast<std::streamsize>(sourceMap.size() * sizeof(SourceRange)));
+    out.write(source.data(), static_cast<std::streamsize>(source.size()));
+    out.close();
+    if (!out) {
+        fs::remove(partial, error);
+        throw std::runtime_error("Cannot write bytecode file " + path + ".");
+    }
+    fs::rename(partial, path, error);
+    if (error) {
+        fs::remove(partial, error);
+        throw std::runtime_error("Cannot write bytecode file " + path + ".");
+    }
+}
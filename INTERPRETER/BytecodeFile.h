@@ -0,0 +1,84 @@
+#ifndef BYTECODEFILE_H
+#define BYTECODEFILE_H
+
+
+#include "Interpreter.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A .bfc file: a compiled program with the settings it was compiled for, laid out so a
+// reader can map it and use the sections where they lie.
+//
+//     BytecodeHeader
+//     Instruction[instructionCount]
+//     SourceRange[instructionCount]   what each instruction was compiled from
+//     char[sourceLength]              the Brainfuck source
+//
+// Fields are in the writer's byte order, which byteOrder records. version changes
+// whenever Instruction, SourceRange or the opcode numbering does.
+struct BytecodeHeader {
+    char magic[4];             // "MBBC"
+    uint16_t version;
+    uint16_t byteOrder;        // 0x0102 as written
+    uint8_t pointerBehavior;
+    uint8_t cellBehavior;
+    uint8_t cellWidth;
+    uint8_t optimizationLevel;
+    int32_t memorySize;        // the tape the jumps and checks were compiled for
+    uint32_t instructionCount;
+    uint32_t sourceLength;
+    uint64_t checksum;         // FNV-1a over the rest of the header and the sections
+};
+
+static_assert(sizeof(BytecodeHeader) == 32, "BytecodeHeader keeps the sections 8-byte aligned");
+
+// A .bfc file opened read-only: mapped where mmap is available, read into memory
+// elsewhere. The constructor checks the header, the size, the checksum and every jump
+// target, and throws std::runtime_error if any is off, so the engines can trust what
+// they get.
+class BytecodeFile {
+    private:
+        const char* data;
+        size_t length;
+        void* mapping;
+        std::vector<uint64_t> buffer;
+
+        void validate(const std::string& path) const;
+
+    public:
+        explicit BytecodeFile(const std::string& path);
+        ~BytecodeFile();
+
+        BytecodeFile(const BytecodeFile&) = delete;
+        BytecodeFile& operator=(const BytecodeFile&) = delete;
+
+        const BytecodeHeader& header() const { return *reinterpret_cast<const BytecodeHeader*>(data); }
+        PointerBehavior pointerBehavior() const { return static_cast<PointerBehavior>(header().pointerBehavior); }
+        CellBehavior cellBehavior() const { return static_cast<CellBehavior>(header().cellBehavior); }
+        CellWidth cellWidth() const { return static_cast<CellWidth>(header().cellWidth); }
+        OptimizationLevel optimizationLevel() const { return static_cast<OptimizationLevel>(header().optimizationLevel); }
+        int memorySize() const { return header().memorySize; }
+
+        int size() const { return static_cast<int>(header().instructionCount); }
+        const Instruction* instructions() const;
+        const SourceRange* sourceMap() const;
+        std::string_view source() const;
+
+        // Writes under a temporary name and renames it into place, so a reader never
+        // sees half a file. Throws std::runtime_error when that fails.
+        static void write(const std::string& path,
+                          const std::vector<Instruction>& program,
+                          const std::vector<SourceRange>& sourceMap,
+                          const std::string& source,
+                          PointerBehavior pointerBehavior,
+                          CellBehavior cellBehavior,
+                          CellWidth cellWidth,
+                          OptimizationLevel optimizationLevel,
+                          int memorySize);
+};
+
+
+#endif //BYTECODEFILE_H
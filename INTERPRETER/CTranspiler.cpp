@@ -0,0 +1,370 @@
+#include "CTranspiler.h"
+#include "JitCompiler.h"
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+
+namespace {
+
+const char* pointerName(PointerBehavior behavior) {
+    switch (behavior) {
+        case PointerBehavior::CLAMP: return "clamp";
+        case PointerBehavior::WRAP: return "wrap";
+        case PointerBehavior::ERROR: return "error";
+        case PointerBehavior::UNBOUNDED: return "unbounded";
+    }
+    return "";
+}
+
+const char* cellName(CellBehavior behavior) {
+    switch (behavior) {
+        case CellBehavior::WRAP: return "wrap";
+        case CellBehavior::UNLIMITED: return "unlimited";
+        case CellBehavior::ERROR: return "error";
+    }
+    return "";
+}
+
+// UNLIMITED cells stay a plain int whatever the width, matching the interpreter's tape.
+const char* cellType(CellBehavior behavior, CellWidth width) {
+    if (behavior == CellBehavior::UNLIMITED) {
+        return "int";
+    }
+    switch (width) {
+        case CellWidth::BITS_16: return "uint16_t";
+        case CellWidth::BITS_32: return "uint32_t";
+        case CellWidth::BITS_8:
+        default: return "uint8_t";
+    }
+}
+
+const char* cellMax(CellWidth width) {
+    switch (width) {
+        case CellWidth::BITS_16: return "65535LL";
+        case CellWidth::BITS_32: return "4294967295LL";
+        case CellWidth::BITS_8:
+        default: return "255LL";
+    }
+}
+
+std::string at(long long offset) {
+    if (offset == 0) {
+        return "p";
+    }
+    return offset > 0 ? "p + " + std::to_string(offset) : "p - " + std::to_string(-offset);
+}
+
+std::string cell(long long offset) {
+    return "m[" + at(offset) + "]";
+}
+
+std::string label(int ip) {
+    return std::string("L").append(std::to_string(ip));
+}
+
+// Empty when the whole range is the current cell, which is always on the tape.
+std::string rangeCheck(long long low, long long high) {
+    std::string check;
+    if (low < 0) {
+        check += "!MB_IN(" + at(low) + ")";
+    }
+    if (high > 0) {
+        check += (check.empty() ? "" : " || ") + std::string("!MB_IN(") + at(high) + ")";
+    }
+    return check;
+}
+
+}
+
+std::string CTranspiler::generate(const std::vector<Instruction>& program,
+                                  PointerBehavior pointerBehavior,
+                                  CellBehavior cellBehavior,
+                                  CellWidth cellWidth,
+                                  int memorySize) {
+    const int size = static_cast<int>(program.size());
+    std::vector<long long> reachLow;
+    std::vector<long long> reachHigh;
+    JitCompiler::straightReach(program, reachLow, reachHigh);
+
+    // Steps are charged like the JIT charges them: a straight run at its end, any other
+    // op as it starts, and a deopt for the part of its run that has executed.
+    std::vector<int> runStart(size + 1);
+    for (int i = 0; i <= size; ++i) {
+        bool midRun = i > 0 && i < size && JitCompiler::isStraightOp(program[i].op) &&
+                      JitCompiler::isStraightOp(program[i - 1].op);
+        runStart[i] = midRun ? runStart[i - 1] : i;
+    }
+    auto deopt = [&](int i) {
+        std::string exit = "MB_EXIT(" + std::to_string(i) + ", MB_DEOPT);";
+        if (runStart[i] == i) {
+            return exit;
+        }
+        return "{ budget -= " + std::to_string(i - runStart[i]) + "; " + exit + " }";
+    };
+
+    std::ostringstream c;
+    c << "/* Generated by MindBoggler: " << size << " instructions, pointer "
+      << pointerName(pointerBehavior) << ", cells " << cellName(cellBehavior) << " "
+      << cellType(cellBehavior, cellWidth) << ", " << memorySize << " cells. */\n\n";
+
+    c << "#include <stdint.h>\n\n";
+    c << "typedef " << cellType(cellBehavior, cellWidth) << " mb_cell;\n\n";
+
+    c << "struct mb_context {\n"
+         "    void* memory;\n"
+         "    int pointer;\n"
+         "    int ip;\n"
+         "    int budget;\n"
+         "    int outputLength;\n"
+         "    const unsigned char* entry;\n"
+         "    void* owner;\n"
+         "    void (*flush)(struct mb_context* ctx);\n"
+         "    int (*input)(struct mb_context* ctx, int index);\n"
+         "    int (*clearLoop)(struct mb_context* ctx, int pc, int pointer);\n"
+         "    int (*multiplyLoop)(struct mb_context* ctx, int pc, int pointer);\n"
+         "    char output[4096];\n"
+         "};\n\n";
+
+    c << "enum { MB_END = 0, MB_BUDGET = 1, MB_DEOPT = 2, MB_ERROR = 3, MB_BREAK = 4 };\n\n";
+    c << "#define MB_TAPE " << memorySize << "\n";
+    c << "#define MB_CELL_MAX " << cellMax(cellWidth) << "\n";
+    c << "#define MB_IN(i) ((unsigned)(i) < MB_TAPE)\n";
+    c << "#define MB_EXIT(at, why) do { ctx->ip = (at); ctx->pointer = p; ctx->budget = budget; return (why); } while (0)\n";
+    c << "#define MB_PUT(v) do { ctx->output[ctx->outputLength++] = (char)(v); "
+         "if (ctx->outputLength == (int)sizeof ctx->output) ctx->flush(ctx); } while (0)\n\n";
+
+    // Only ops that start a straight run or aren't straight can be entered: the host
+    // finishes a run it deopted in the interpreter. Every entry would otherwise be a
+    // separate way into the run for the C compiler to optimize.
+    c << "int mb_run(struct mb_context* ctx) {\n"
+         "    mb_cell* m = (mb_cell*)ctx->memory;\n"
+         "    int p = ctx->pointer;\n"
+         "    int budget = ctx->budget;\n\n"
+         "    switch (ctx->ip) {\n";
+    for (int i = 0; i < size; ++i) {
+        if (runStart[i] == i && program[i].op != OpCode::MUL_TERM) {
+            c << "        case " << i << ": goto " << label(i) << ";\n";
+        }
+    }
+    c << "        default: MB_EXIT(" << size << ", MB_END);\n"
+         "    }\n\n";
+
+    for (int i = 0; i < size; ++i) {
+        const Instruction& ins = program[i];
+        const std::string after = label(ins.arg + 1);
+        c << label(i) << ":\n";
+
+        if (JitCompiler::isStraightOp(ins.op) && (i == 0 || !JitCompiler::isStraightOp(program[i - 1].op))) {
+            std::string check = rangeCheck(reachLow[i], reachHigh[i]);
+            if (!check.empty()) {
+                c << "    if (" << check << ") MB_EXIT(" << i << ", MB_DEOPT);\n";
+            }
+        }
+        if (!JitCompiler::isStraightOp(ins.op) && ins.op != OpCode::MUL_TERM && ins.op != OpCode::BREAK) {
+            c << "    budget--;\n";
+        }
+
+        switch (ins.op) {
+            case OpCode::ADD:
+                if (cellBehavior != CellBehavior::ERROR) {
+                    c << "    " << cell(ins.offset) << " += " << ins.arg << ";\n";
+                } else {
+                    c << "    { long long v = (long long)" << cell(ins.offset) << " + " << ins.arg
+                      << "; if (v < 0 || v > MB_CELL_MAX) " << deopt(i) << " "
+                      << cell(ins.offset) << " = (mb_cell)v; }\n";
+                }
+                break;
+            case OpCode::MOVE:
+                c << "    p = " << at(ins.arg) << ";\n";
+                break;
+            case OpCode::OUTPUT:
+                if (cellBehavior == CellBehavior::UNLIMITED) {
+                    c << "    { int v = " << cell(ins.offset) << "; MB_PUT(v < 0 ? 0 : v > 255 ? 255 : v); }\n";
+                } else {
+                    c << "    MB_PUT(" << cell(ins.offset) << ");\n";
+                }
+                break;
+            case OpCode::INPUT:
+                c << "    if (ctx->input(ctx, " << at(ins.offset) << ")) MB_EXIT(" << i << ", MB_ERROR);\n";
+                break;
+            case OpCode::LOOP_START:
+                c << "    if (!m[p]) goto " << after << ";\n";
+                break;
+            case OpCode::LOOP_END:
+                c << "    if (m[p]) { if (budget < 0) MB_EXIT(" << ins.arg + 1 << ", MB_BUDGET); goto "
+                  << after << "; }\n";
+                break;
+            case OpCode::CLEAR:
+                c << "    if (!m[p]) goto " << after << ";\n";
+                if (cellBehavior == CellBehavior::WRAP) {
+                    c << "    m[p] = 0;\n    goto " << after << ";\n";
+                } else {
+                    c << "    if (ctx->clearLoop(ctx, " << i << ", p)) goto " << after << ";\n";
+                }
+                break;
+            case OpCode::MULTIPLY: {
+                c << "    if (!m[p]) goto " << after << ";\n";
+                if (cellBehavior != CellBehavior::WRAP) {
+                    c << "    if (ctx->multiplyLoop(ctx, " << i << ", p)) goto " << after << ";\n";
+                    break;
+                }
+                long long low = 0;
+                long long high = 0;
+                int body = i + 1;
+                for (; program[body].op == OpCode::MUL_TERM; ++body) {
+                    low = std::min<long long>(low, program[body].offset);
+                    high = std::max<long long>(high, program[body].offset);
+                }
+                std::string check = rangeCheck(low, high);
+                c << (check.empty() ? "    {\n" : "    if (!(" + check + ")) {\n");
+                c << "        unsigned n = " << (program[i + 1].arg == 1 ? "(mb_cell)(0u - m[p])" : "m[p]") << ";\n";
+                for (int t = i + 2; t < body; ++t) {
+                    if (program[t].arg == 0) {
+                        continue;
+                    }
+                    c << "        " << cell(program[t].offset) << " = (mb_cell)((unsigned)" << cell(program[t].offset)
+                      << " + n * (unsigned)(" << program[t].arg << "));\n";
+                }
+                c << "        m[p] = 0;\n        goto " << after << ";\n    }\n";
+                break;
+            }
+            case OpCode::MUL_TERM:
+                break;
+            case OpCode::SCAN:
+                c << "    while (m[p]) { if (!MB_IN(" << at(ins.offset) << ")) goto " << label(i + 1)
+                  << "; p = " << at(ins.offset) << "; }\n    goto " << after << ";\n";
+                break;
+            case OpCode::BREAK:
+                c << "    MB_EXIT(" << i + 1 << ", MB_BREAK);\n";
+                break;
+        }
+        if (JitCompiler::isStraightOp(ins.op) && runStart[i + 1] == i + 1) {
+            c << "    budget -= " << i + 1 - runStart[i] << ";\n";
+        }
+    }
+    c << label(size) << ":\n    MB_EXIT(" << size << ", MB_END);\n}\n\n";
+
+    c << "#ifdef MB_STANDALONE\n"
+         "#include <stdio.h>\n"
+         "#include <stdlib.h>\n\n";
+
+    // The host answers a deopt by running the rest of that straight run in the
+    // interpreter; the standalone program does the same here, with the interpreter's edge
+    // handling. Each case falls through to the next op of its run.
+    c << "/* The cell at i, or -1 where the interpreter raises an error. */\n"
+         "static long long mb_at(long long i) {\n"
+         "    if (MB_IN(i)) return i;\n";
+    switch (pointerBehavior) {
+        case PointerBehavior::CLAMP:
+            c << "    return i < 0 ? 0 : MB_TAPE - 1;\n";
+            break;
+        case PointerBehavior::WRAP:
+            c << "    return ((i % MB_TAPE) + MB_TAPE) % MB_TAPE;\n";
+            break;
+        case PointerBehavior::ERROR:
+        case PointerBehavior::UNBOUNDED:
+            c << "    return -1;\n";
+            break;
+    }
+    c << "}\n\n";
+
+    c << "static int mb_step(struct mb_context* ctx) {\n"
+         "    mb_cell* m = (mb_cell*)ctx->memory;\n"
+         "    long long i;\n"
+         "    switch (ctx->ip) {\n";
+    for (int i = 0; i < size; ++i) {
+        const Instruction& ins = program[i];
+        const std::string target = "(long long)ctx->pointer + " + std::to_string(ins.offset);
+        const std::string fail = "{ ctx->ip = " + std::to_string(i) + "; return 1; }";
+        switch (ins.op) {
+            case OpCode::ADD:
+                c << "        case " << i << ": {\n"
+                     "            long long v;\n"
+                     "            if ((i = mb_at(" << target << ")) < 0) " << fail << "\n"
+                     "            v = (long long)m[i] + " << ins.arg << ";\n";
+                if (cellBehavior == CellBehavior::ERROR) {
+                    c << "            if (v < 0 || v > MB_CELL_MAX) " << fail << "\n";
+                }
+                c << "            m[i] = (mb_cell)v;\n"
+                     "        }\n";
+                break;
+            case OpCode::MOVE:
+                c << "        case " << i << ":\n"
+                     "            if ((i = mb_at((long long)ctx->pointer + " << ins.arg << ")) < 0) " << fail << "\n"
+                     "            ctx->pointer = (int)i;\n";
+                break;
+            case OpCode::OUTPUT:
+                c << "        case " << i << ":\n"
+                     "            if ((i = mb_at(" << target << ")) < 0) " << fail << "\n";
+                if (cellBehavior == CellBehavior::UNLIMITED) {
+                    c << "            MB_PUT(m[i] < 0 ? 0 : m[i] > 255 ? 255 : m[i]);\n";
+                } else {
+                    c << "            MB_PUT(m[i]);\n";
+                }
+                break;
+            case OpCode::INPUT:
+                c << "        case " << i << ":\n"
+                     "            if ((i = mb_at(" << target << ")) < 0) " << fail << "\n"
+                     "            if (ctx->input(ctx, (int)i)) " << fail << "\n";
+                break;
+            default:
+                continue;
+        }
+        if (runStart[i + 1] == i + 1) {
+            c << "            ctx->ip = " << i + 1 << ";\n"
+                 "            return 0;\n";
+        }
+    }
+    c << "        default: return 1;\n"
+         "    }\n"
+         "}\n\n";
+
+    c <<          "static void mb_flush(struct mb_context* ctx) {\n"
+         "    fwrite(ctx->output, 1, (size_t)ctx->outputLength, stdout);\n"
+         "    ctx->outputLength = 0;\n"
+         "}\n\n"
+         "static int mb_input(struct mb_context* ctx, int index) {\n"
+         "    int ch = getchar();\n"
+         "    ((mb_cell*)ctx->memory)[index] = ch == EOF ? 0 : (mb_cell)(char)ch;\n"
+         "    return 0;\n"
+         "}\n\n"
+         "static int mb_run_loop(struct mb_context* ctx, int pc, int pointer) {\n"
+         "    (void)ctx; (void)pc; (void)pointer;\n"
+         "    return 0;\n"
+         "}\n\n"
+         "int main(void) {\n"
+         "    static struct mb_context ctx;\n"
+         "    ctx.memory = calloc(MB_TAPE, sizeof(mb_cell));\n"
+         "    if (!ctx.memory) return 1;\n"
+         "    ctx.flush = mb_flush;\n"
+         "    ctx.input = mb_input;\n"
+         "    ctx.clearLoop = mb_run_loop;\n"
+         "    ctx.multiplyLoop = mb_run_loop;\n"
+         "    for (;;) {\n"
+         "        int why;\n"
+         "        ctx.budget = 1 << 30;\n"
+         "        why = mb_run(&ctx);\n"
+         "        if (why == MB_DEOPT && !mb_step(&ctx)) why = MB_BUDGET;\n"
+         "        mb_flush(&ctx);\n"
+         "        if (why == MB_END) return 0;\n"
+         "        if (why != MB_BUDGET && why != MB_BREAK) {\n"
+         "            fprintf(stderr, \"stopped at instruction %d: the pointer left the tape or a cell overflowed\\n\", ctx.ip);\n"
+         "            return 1;\n"
+         "        }\n"
+         "    }\n"
+         "}\n"
+         "#endif\n";
+
+    return c.str();
+}
+
+std::string CTranspiler::hash(const std::string& source) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char ch : source) {
+        h ^= ch;
+        h *= 1099511628211ULL;
+    }
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(h));
+    return text;
+}
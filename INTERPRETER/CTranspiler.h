@@ -0,0 +1,24 @@
+#ifndef CTRANSPILER_H
+#define CTRANSPILER_H
+
+
+#include "Interpreter.h"
+#include <string>
+#include <vector>
+
+class CTranspiler {
+    public:
+        // Emits a C translation unit exporting `int mb_run(struct mb_context*)`, which runs
+        // the program from ctx->ip and returns the same exit codes as the native JIT.
+        // Building it with -DMB_STANDALONE adds a main() that uses stdin/stdout.
+        static std::string generate(const std::vector<Instruction>& program,
+                                    PointerBehavior pointerBehavior,
+                                    CellBehavior cellBehavior,
+                                    CellWidth cellWidth,
+                                    int memorySize);
+
+        static std::string hash(const std::string& source);
+};
+
+
+#endif //CTRANSPILER_H
@@ -0,0 +1,184 @@
+#include "ExecutionThread.h"
+#include <algorithm>
+
+namespace {
+
+thread_local const ExecutionThread* runningThread = nullptr;
+
+}
+
+ExecutionThread::ExecutionThread(Interpreter& interp)
+    : interp(interp), currentState(ExecutionState::IDLE), pauseRequested(false),
+      maxSteps(0), watchFirst(0), watchCount(0), slice(0), publishInterval(0),
+      chunk(MIN_CHUNK), waitedForInput(false), publishedSteps(0), opsPerSecond(0),
+      back(0), front(1), middle(2) {}
+
+ExecutionThread::~ExecutionThread() {
+    stop();
+}
+
+void ExecutionThread::start(const std::set<int>& breakpoints, int maxSteps,
+                            std::chrono::steady_clock::duration slice,
+                            std::chrono::steady_clock::duration publishInterval) {
+    join();
+
+    this->maxSteps = maxSteps;
+    this->slice = slice;
+    this->publishInterval = publishInterval;
+    chunk = MIN_CHUNK;
+    publishedSteps = interp.getFastSteps();
+    publishedAt = std::chrono::steady_clock::now();
+    opsPerSecond = 0;
+    interp.setBreakpoints(breakpoints);
+    error = nullptr;
+    middle.store(middle.load(std::memory_order_relaxed) & ~FRESH, std::memory_order_relaxed);
+    pauseRequested.store(false, std::memory_order_relaxed);
+    currentState.store(ExecutionState::RUNNING, std::memory_order_relaxed);
+
+    worker = std::thread(&ExecutionThread::run, this);
+}
+
+void ExecutionThread::pause() {
+    pauseRequested.store(true);
+}
+
+void ExecutionThread::stop() {
+    pause();
+    provideInput("");
+    join();
+}
+
+void ExecutionThread::join() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool ExecutionThread::isWorker() const {
+    return runningThread == this;
+}
+
+void ExecutionThread::watch(int first, int count) {
+    watchFirst.store(first, std::memory_order_relaxed);
+    watchCount.store(count, std::memory_order_relaxed);
+}
+
+void ExecutionThread::run() {
+    runningThread = this;
+    ExecutionState result = ExecutionState::FINISHED;
+    auto lastPublish = std::chrono::steady_clock::now();
+
+    try {
+        publish();
+        while (true) {
+            if (pauseRequested.load(std::memory_order_relaxed)) {
+                result = ExecutionState::PAUSED;
+                break;
+            }
+            waitedForInput = false;
+            auto began = std::chrono::steady_clock::now();
+            if (!interp.runProgramFastInterruptible(chunk, maxSteps)) {
+                break;
+            }
+            if (interp.getBreakpointHit() >= 0) {
+                result = ExecutionState::BREAKPOINT;
+                break;
+            }
+
+            // Time spent waiting for input says nothing about the ops, so only a chunk
+            // that ran straight through resizes the next one.
+            auto now = std::chrono::steady_clock::now();
+            if (!waitedForInput) {
+                if (now - began < slice / 2 && chunk <= MAX_CHUNK / 2) {
+                    chunk *= 2;
+                } else if (now - began > slice && chunk >= MIN_CHUNK * 2) {
+                    chunk /= 2;
+                }
+            }
+            if (now - lastPublish >= publishInterval) {
+                publish();
+                lastPublish = now;
+            }
+        }
+    } catch (...) {
+        error = std::current_exception();
+        result = ExecutionState::FAILED;
+    }
+
+    publish();
+    currentState.store(result, std::memory_order_release);
+}
+
+// Fills the back slot and swaps it into the middle; the reader swaps the middle with
+// its front slot. Neither side ever waits on the other.
+void ExecutionThread::publish() {
+    ExecutionSnapshot& snapshot = snapshots[back];
+    snapshot.pc = interp.getPc();
+    snapshot.pointer = interp.getPointer();
+    snapshot.cell = interp.getCell(snapshot.pointer);
+    snapshot.memorySize = interp.getMemorySize();
+    snapshot.steps = interp.getFastSteps();
+
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - publishedAt;
+    if (elapsed.count() > 0 && snapshot.steps != publishedSteps) {
+        opsPerSecond = (snapshot.steps - publishedSteps) / elapsed.count();
+        publishedSteps = snapshot.steps;
+        publishedAt = now;
+    }
+    snapshot.opsPerSecond = opsPerSecond;
+    snapshot.windowStart = std::clamp(watchFirst.load(std::memory_order_relaxed), 0, snapshot.memorySize);
+    int windowEnd = std::min(snapshot.memorySize,
+                             snapshot.windowStart + std::max(0, watchCount.load(std::memory_order_relaxed)));
+
+    snapshot.window.clear();
+    for (int i = snapshot.windowStart; i < windowEnd; ++i) {
+        snapshot.window.push_back(interp.getCell(i));
+    }
+
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+const ExecutionSnapshot* ExecutionThread::latestSnapshot() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+        return nullptr;
+    }
+    front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+    return &snapshots[front];
+}
+
+// The callback runs on the worker, so the request is handed to the UI thread through
+// the state and the worker sleeps until provideInput() answers it. stop() answers with
+// nothing; if it checked the state just before we got here, we see its pause instead.
+std::string ExecutionThread::waitForInput() {
+    waitedForInput = true;
+    currentState.store(ExecutionState::WAITING_INPUT);
+    if (pauseRequested.load()) {
+        ExecutionState waiting = ExecutionState::WAITING_INPUT;
+        if (currentState.compare_exchange_strong(waiting, ExecutionState::RUNNING)) {
+            return std::string();
+        }
+    }
+
+    currentState.wait(ExecutionState::WAITING_INPUT);
+    return std::move(inputReply);
+}
+
+void ExecutionThread::provideInput(const std::string& text) {
+    if (currentState.load() != ExecutionState::WAITING_INPUT) {
+        return;
+    }
+    inputReply = text;
+    ExecutionState waiting = ExecutionState::WAITING_INPUT;
+    if (currentState.compare_exchange_strong(waiting, ExecutionState::RUNNING)) {
+        currentState.notify_one();
+    }
+}
+
+void ExecutionThread::rethrowError() {
+    if (error) {
+        std::exception_ptr pending = error;
+        error = nullptr;
+        std::rethrow_exception(pending);
+    }
+}
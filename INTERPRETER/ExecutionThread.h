@@ -0,0 +1,113 @@
+#ifndef EXECUTIONTHREAD_H
+#define EXECUTIONTHREAD_H
+
+
+#include "Interpreter.h"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class ExecutionState {
+    IDLE,          // Never started
+    RUNNING,       // The worker is executing
+    WAITING_INPUT, // The worker is blocked in waitForInput() until provideInput()
+    PAUSED,        // Stopped by pause() or stop()
+    BREAKPOINT,    // Stopped on a breakpoint trap
+    FINISHED,      // The program ended or used up its steps
+    FAILED         // The run threw, rethrowError() raises it again
+};
+
+// What the UI draws of a run in progress. window holds the cells
+// [windowStart, windowStart + window.size()) of the range passed to watch(), and cell
+// the one under the pointer. opsPerSecond is the rate since the previous snapshot.
+struct ExecutionSnapshot {
+    int pc = 0;
+    int pointer = 0;
+    long long cell = 0;
+    int memorySize = 0;
+    int steps = 0;
+    double opsPerSecond = 0;
+    int windowStart = 0;
+    std::vector<long long> window;
+};
+
+// Runs an interpreter in Fast mode on a worker thread. The worker publishes snapshots
+// through a lock-free triple buffer at most once per publish interval, and checks the
+// pause flag between chunks. Chunks are sized to take about one slice each, whatever
+// the program's ops cost. While the worker runs, only the worker touches the
+// interpreter; once state() has left RUNNING/WAITING_INPUT and join() returned, the
+// caller owns it again.
+class ExecutionThread {
+    private:
+        static constexpr int FRESH = 4;
+        static constexpr int MIN_CHUNK = 1 << 10;
+        static constexpr int MAX_CHUNK = 1 << 26;
+
+        Interpreter& interp;
+        std::thread worker;
+        std::atomic<ExecutionState> currentState;
+        std::atomic<bool> pauseRequested;
+        std::exception_ptr error;
+        std::string inputReply;
+
+        int maxSteps;
+        std::atomic<int> watchFirst;
+        std::atomic<int> watchCount;
+        std::chrono::steady_clock::duration slice;
+        std::chrono::steady_clock::duration publishInterval;
+
+        int chunk;
+        bool waitedForInput;
+        int publishedSteps;
+        std::chrono::steady_clock::time_point publishedAt;
+        double opsPerSecond;
+
+        ExecutionSnapshot snapshots[3];
+        int back;
+        int front;
+        std::atomic<int> middle;
+
+        void run();
+        void publish();
+
+    public:
+        explicit ExecutionThread(Interpreter& interp);
+        ~ExecutionThread();
+
+        ExecutionThread(const ExecutionThread&) = delete;
+        ExecutionThread& operator=(const ExecutionThread&) = delete;
+
+        // Starts or resumes the loaded program from where it is.
+        void start(const std::set<int>& breakpoints, int maxSteps,
+                   std::chrono::steady_clock::duration slice,
+                   std::chrono::steady_clock::duration publishInterval);
+        // Asks the worker to stop after the current chunk.
+        void pause();
+        // pause(), unblocks a pending input request and waits for the worker.
+        void stop();
+        void join();
+        // The cells to copy into snapshots, typically what the UI has on screen. Can be
+        // changed while the worker runs.
+        void watch(int first, int count);
+
+        ExecutionState state() const { return currentState.load(std::memory_order_acquire); }
+        bool isActive() const { return worker.joinable(); }
+        bool isWorker() const;
+
+        // The newest snapshot, or nullptr if none was published since the last call.
+        // It stays valid until the next call.
+        const ExecutionSnapshot* latestSnapshot();
+
+        // Worker side, for the interpreter's input callback: waits for provideInput().
+        std::string waitForInput();
+        void provideInput(const std::string& text);
+
+        void rethrowError();
+};
+
+
+#endif //EXECUTIONTHREAD_H
@@ -0,0 +1,89 @@
+#include "InputSource.h"
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MB_MMAP_INPUT 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define MB_MMAP_INPUT 0
+#endif
+
+StringInput::StringInput(std::string data) : data(std::move(data)) {
+    cursor = this->data.data();
+    end = cursor + this->data.size();
+}
+
+FileInput::FileInput(const std::string& path) : mapping(nullptr), mappingSize(0) {
+#if MB_MMAP_INPUT
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open input file: " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* region = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (region != MAP_FAILED) {
+            mapping = region;
+            mappingSize = static_cast<size_t>(info.st_size);
+            madvise(region, mappingSize, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    if (mapping) {
+        cursor = static_cast<const char*>(mapping);
+        end = cursor + mappingSize;
+        return;
+    }
+#endif
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open input file: " + path);
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    cursor = data.data();
+    end = cursor + data.size();
+}
+
+FileInput::~FileInput() {
+#if MB_MMAP_INPUT
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+#endif
+}
+
+StreamInput::StreamInput(std::FILE* stream, size_t chunkSize) : stream(stream), chunk(chunkSize) {}
+
+// Takes whatever is available rather than waiting for a full chunk, so a program
+// reading from a terminal sees each line as soon as it is entered.
+bool StreamInput::refill() {
+    size_t count = 0;
+#if MB_MMAP_INPUT
+    ssize_t received;
+    do {
+        received = ::read(fileno(stream), chunk.data(), chunk.size());
+    } while (received < 0 && errno == EINTR);
+    count = received > 0 ? static_cast<size_t>(received) : 0;
+#else
+    int ch;
+    while (count < chunk.size() && (ch = std::getc(stream)) != EOF) {
+        chunk[count++] = static_cast<char>(ch);
+        if (ch == '\n') {
+            break;
+        }
+    }
+#endif
+    if (count == 0) {
+        return false;
+    }
+    cursor = chunk.data();
+    end = cursor + count;
+    return true;
+}
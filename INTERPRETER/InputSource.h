@@ -0,0 +1,75 @@
+#ifndef INPUTSOURCE_H
+#define INPUTSOURCE_H
+
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Where `,` reads from. Sources expose their current chunk as a cursor range, so a read
+// is a pointer bump and only running off the end of a chunk goes through refill().
+class InputSource {
+    protected:
+        const char* cursor;
+        const char* end;
+
+        // Points cursor/end at the next chunk. Returns false at the end of input.
+        virtual bool refill() { return false; }
+
+    public:
+        InputSource() : cursor(nullptr), end(nullptr) {}
+        virtual ~InputSource() = default;
+
+        InputSource(const InputSource&) = delete;
+        InputSource& operator=(const InputSource&) = delete;
+
+        // Bytes are returned as signed chars, the same values the UI has always fed in.
+        // True while read() can be served without asking for more input.
+        bool buffered() const { return cursor != end; }
+
+        bool read(int& value) {
+            if (cursor == end && !refill()) {
+                return false;
+            }
+            value = static_cast<int>(*cursor++);
+            return true;
+        }
+};
+
+class StringInput : public InputSource {
+    private:
+        std::string data;
+
+    public:
+        explicit StringInput(std::string data);
+};
+
+// Maps the whole file where mmap is available and reads it in one go elsewhere.
+class FileInput : public InputSource {
+    private:
+        void* mapping;
+        size_t mappingSize;
+        std::string data;
+
+    public:
+        explicit FileInput(const std::string& path);
+        ~FileInput() override;
+};
+
+// Reads a stream such as stdin in chunks as the program asks for it. It reads the
+// underlying descriptor directly, so don't mix it with other reads from the stream.
+class StreamInput : public InputSource {
+    private:
+        std::FILE* stream;
+        std::vector<char> chunk;
+
+    protected:
+        bool refill() override;
+
+    public:
+        explicit StreamInput(std::FILE* stream, size_t chunkSize = 1 << 16);
+};
+
+
+#endif //INPUTSOURCE_H
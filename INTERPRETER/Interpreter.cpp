@@ -1,54 +1,333 @@
 #include "Interpreter.h"
+#include "JitCompiler.h"
+#include "CTranspiler.h"
+#include "BytecodeFile.h"
 #include <algorithm>
+#include <climits>
+#include <limits>
+#include <filesystem>
 #include <stack>
 #include <sstream>
 #include <iostream>
 #include <set>
+#include <map>
+
+namespace {
+
+// Hands buffered output to the sink however a run ends, so output printed before an
+// error is still seen.
+struct FlushOutput {
+    OutputSink& sink;
+    ~FlushOutput() { sink.flush(); }
+};
+
+// The breakpoints a compiled program was built with, read back from its traps.
+std::set<int> trapsOf(const BytecodeFile& file) {
+    std::set<int> traps;
+    for (int i = 0; i < file.size(); ++i) {
+        if (file.instructions()[i].op == OpCode::BREAK) {
+            traps.insert(file.instructions()[i].arg);
+        }
+    }
+    return traps;
+}
+
+}
+
+// How far an UNBOUNDED pointer may go. Only reserved address space, so it is sized
+// to stay well clear of the 32-bit cell indices the engines use.
+static const int unboundedCells = sizeof(void*) >= 8 ? 1 << 28 : 1 << 22;
 
 Interpreter::Interpreter(int memorySize)
-    : memorySize(memorySize), pointer(0), pc(0), running(false),
-      fastPc(0), fastSteps(0),
+    : output(std::make_unique<BufferOutput>()),
+      configuredSize(memorySize), memorySize(memorySize), pointer(0), pc(0), running(false),
+      fastPc(0), fastSteps(0), breakpointHit(-1), dirty{INT_MAX, -1},
+      unsaved{INT_MAX, -1}, inputLogStart(0), inputCursor(0), loggingInput(false),
+      session(0), compiledVersion(0),
+      recordingSteps(false), historySteps(0), historyStart(0),
       pointerBehavior(PointerBehavior::CLAMP),
-      cellBehavior(CellBehavior::WRAP) {
+      cellBehavior(CellBehavior::WRAP),
+      cellWidth(CellWidth::BITS_8),
+      dispatchMode(DispatchMode::THREADED), optimizationLevel(OptimizationLevel::IDIOMS),
+      jitFailed(false), cachedKey{} {
     reset();
 }
 
-void Interpreter::configure(PointerBehavior ptrBehavior, CellBehavior cellBehavior) {
+Interpreter::~Interpreter() = default;
+
+void Interpreter::configure(PointerBehavior ptrBehavior, CellBehavior cellBehavior, CellWidth cellWidth) {
+    CellType previousType = cellType();
+    int previousSize = memorySize;
+
     this->pointerBehavior = ptrBehavior;
     this->cellBehavior = cellBehavior;
+    this->cellWidth = cellWidth;
+    memorySize = ptrBehavior == PointerBehavior::UNBOUNDED ? unboundedCells : configuredSize;
+    dropHistory();
+
+    // A different cell type or tape length means a different layout, which starts empty.
+    if (cellType() != previousType || memorySize != previousSize) {
+        allocateTape();
+        pointer = std::min(pointer, memorySize - 1);
+    }
+    discardJit();
+}
+
+void Interpreter::setDispatchMode(DispatchMode mode) {
+    if (mode != dispatchMode) {
+        dispatchMode = mode;
+        discardJit();
+    }
+}
+
+void Interpreter::setOptimizationLevel(OptimizationLevel level) {
+    if (level != optimizationLevel) {
+        optimizationLevel = level;
+        stashCompiled();
+        discardJit();
+        fastPc = -1;
+    }
+}
+
+void Interpreter::setBreakpoints(const std::set<int>& offsets) {
+    if (offsets != breakpoints) {
+        breakpoints = offsets;
+        stashCompiled();
+        discardJit();
+        fastPc = -1;
+    }
+}
+
+void Interpreter::discardJit() {
+    jit.reset();
+    jitFailed = false;
 }
 
 void Interpreter::reset() {
     pointer = 0;
-    memory.assign(memorySize, 0);
+    allocateTape();
     program.clear();
+    bracketMatch.clear();
     pc = 0;
-    outputBuffer.clear();
-    inputBuffer.clear();
+    output->clear();
+    input.reset();
+    inputLog.clear();
+    inputLogStart = 0;
+    inputCursor = 0;
+    loggingInput = false;
     running = false;
-    compiledProgram.clear();
+    stashCompiled();
+    discardJit();
     fastPc = 0;
     fastSteps = 0;
+    breakpointHit = -1;
 }
 
 void Interpreter::loadProgram(const std::string& program, const std::string& inputData) {
     this->program = program;
+    bracketMatch.clear();
     pc = 0;
-    outputBuffer.clear();
-    inputBuffer.clear();
+    output->clear();
+    input = inputData.empty() ? nullptr : std::make_unique<StringInput>(inputData);
+    inputLog.clear();
+    inputLogStart = 0;
+    inputCursor = 0;
+    loggingInput = false;
+    session++;
+    dropHistory();
+
+    running = true;
+    stashCompiled();
+    discardJit();
+    fastPc = 0;
+    fastSteps = 0;
+    breakpointHit = -1;
+}
+
+void Interpreter::saveBytecode(const std::string& path) {
+    if (compiledProgram.empty()) {
+        compileProgram();
+    }
+    BytecodeFile::write(path, compiledProgram, sourceMap, program,
+                        pointerBehavior, cellBehavior, cellWidth, optimizationLevel, memorySize);
+}
 
-    for (char c : inputData) {
-        inputBuffer.push_back(static_cast<int>(c));
+// Everything a compile would produce comes from the file, so the result is the same as
+// configuring, loading the source and compiling it, without parsing anything.
+void Interpreter::loadBytecode(const std::string& path, const std::string& inputData) {
+    BytecodeFile file(path);
+    if (file.pointerBehavior() == PointerBehavior::UNBOUNDED && file.memorySize() != unboundedCells) {
+        throw std::runtime_error("Bad bytecode file " + path + ": built for a different unbounded tape.");
     }
 
-    running = true;
-    compiledProgram.clear();
+    if (file.pointerBehavior() != PointerBehavior::UNBOUNDED) {
+        configuredSize = file.memorySize();
+    }
+    configure(file.pointerBehavior(), file.cellBehavior(), file.cellWidth());
+    optimizationLevel = file.optimizationLevel();
+    breakpoints = trapsOf(file);
+    loadProgram(std::string(file.source()), inputData);
+
+    compiledProgram.assign(file.instructions(), file.instructions() + file.size());
+    sourceMap.assign(file.sourceMap(), file.sourceMap() + file.size());
+    cachedSource = compiledProgram.empty() ? std::string() : program;
+    cachedKey = compileKey();
+}
+
+Interpreter::CellType Interpreter::cellType() const {
+    if (cellBehavior == CellBehavior::UNLIMITED) {
+        return CellType::INT;
+    }
+    switch (cellWidth) {
+        case CellWidth::BITS_16: return CellType::U16;
+        case CellWidth::BITS_32: return CellType::U32;
+        case CellWidth::BITS_8:
+        default: return CellType::U8;
+    }
+}
+
+int Interpreter::cellBytes() const {
+    switch (cellType()) {
+        case CellType::U8: return 1;
+        case CellType::U16: return 2;
+        case CellType::U32:
+        case CellType::INT:
+        default: return 4;
+    }
+}
+
+long long Interpreter::cellMax() const {
+    switch (cellType()) {
+        case CellType::U8: return UINT8_MAX;
+        case CellType::U16: return UINT16_MAX;
+        case CellType::U32: return UINT32_MAX;
+        case CellType::INT:
+        default: return INT_MAX;
+    }
+}
+
+void Interpreter::allocateTape() {
+    size_t bytes = static_cast<size_t>(memorySize) * cellBytes();
+    if (memory.size() == bytes) {
+        memory.clear();
+    } else {
+        memory.allocate(bytes);
+    }
+    savedTape = TapeImage();
+    session++;
+    dropHistory();
+    markDirty(0, memorySize - 1);
+}
+
+void Interpreter::markDirty(int first, int last) {
+    dirty.first = std::min(dirty.first, first);
+    dirty.last = std::max(dirty.last, last);
+    unsaved.first = std::min(unsaved.first, first);
+    unsaved.last = std::max(unsaved.last, last);
+}
+
+CellRange Interpreter::takeDirtyCells() {
+    CellRange changed = dirty;
+    dirty = {INT_MAX, -1};
+    return changed;
+}
+
+InterpreterSnapshot Interpreter::snapshot() {
+    const size_t bytes = cellBytes();
+    if (unsaved.first <= unsaved.last) {
+        savedTape = memory.capture(savedTape, unsaved.first * bytes, (unsaved.last + 1) * bytes);
+    } else {
+        savedTape = memory.capture(savedTape, 0, 0);
+    }
+    unsaved = {INT_MAX, -1};
+
+    if (!loggingInput) {
+        loggingInput = true;
+        inputLogStart = inputCursor;
+    }
+
+    InterpreterSnapshot snapshot;
+    snapshot.tape = savedTape;
+    snapshot.pointer = pointer;
+    snapshot.pc = pc;
+    snapshot.running = running;
+    snapshot.fastPc = fastPc;
+    snapshot.fastSteps = fastSteps;
+    snapshot.breakpointHit = breakpointHit;
+    snapshot.outputCursor = output->cursor();
+    snapshot.inputCursor = inputCursor;
+    snapshot.session = session;
+    snapshot.compiledVersion = compiledVersion;
+    return snapshot;
+}
+
+bool Interpreter::restore(const InterpreterSnapshot& snapshot) {
+    if (snapshot.session != session || snapshot.tape.size() != memory.size()) {
+        throw std::runtime_error("Snapshot is from before the program was loaded or the tape was reset.");
+    }
+    // The output goes first, since it is the one part that can fail.
+    if (!output->truncate(snapshot.outputCursor)) {
+        return false;
+    }
+    dropHistory();
+    restoreState(snapshot);
+    return true;
+}
+
+// The output has to be at snapshot.outputCursor already.
+void Interpreter::restoreState(const InterpreterSnapshot& snapshot) {
+    const size_t bytes = cellBytes();
+    if (unsaved.first <= unsaved.last) {
+        memory.restore(snapshot.tape, savedTape, unsaved.first * bytes, (unsaved.last + 1) * bytes);
+    } else {
+        memory.restore(snapshot.tape, savedTape, 0, 0);
+    }
+    savedTape = snapshot.tape;
+    unsaved = {INT_MAX, -1};
+    dirty = {0, memorySize - 1};
+
+    pointer = snapshot.pointer;
+    pc = snapshot.pc;
+    running = snapshot.running;
+    // The compiled position only means something to the program it was taken in.
+    fastPc = snapshot.compiledVersion == compiledVersion ? snapshot.fastPc : -1;
+    fastSteps = snapshot.fastSteps;
+    breakpointHit = snapshot.breakpointHit;
+    inputCursor = snapshot.inputCursor;
+}
+
+long long Interpreter::getCell(int index) const {
+    switch (cellType()) {
+        case CellType::U8: return cells<uint8_t>()[index];
+        case CellType::U16: return cells<uint16_t>()[index];
+        case CellType::U32: return cells<uint32_t>()[index];
+        case CellType::INT: return cells<int>()[index];
+    }
+    return 0;
+}
+
+// Stores value truncated to the cell type, which is how the wrapping widths wrap.
+void Interpreter::writeCell(int index, long long value) {
+    switch (cellType()) {
+        case CellType::U8: cells<uint8_t>()[index] = static_cast<uint8_t>(value); break;
+        case CellType::U16: cells<uint16_t>()[index] = static_cast<uint16_t>(value); break;
+        case CellType::U32: cells<uint32_t>()[index] = static_cast<uint32_t>(value); break;
+        case CellType::INT: cells<int>()[index] = static_cast<int>(value); break;
+    }
 }
 
 void Interpreter::setInputCallback(std::function<std::string()> callback) {
     inputCallback = callback;
 }
 
+void Interpreter::setInputSource(std::unique_ptr<InputSource> source) {
+    input = std::move(source);
+}
+
+void Interpreter::setOutputSink(std::unique_ptr<OutputSink> sink) {
+    output = std::move(sink);
+}
+
 void Interpreter::movePointer(int delta) {
     int newPointer = pointer + delta;
 
@@ -62,6 +341,7 @@ void Interpreter::movePointer(int delta) {
             break;
 
         case PointerBehavior::ERROR:
+        case PointerBehavior::UNBOUNDED:
             if (newPointer < 0) {
                 throw PointerOverflowError("Pointer underflow: attempted to move to " + std::to_string(newPointer));
             } else if (newPointer >= memorySize) {
@@ -74,55 +354,93 @@ void Interpreter::movePointer(int delta) {
     }
 }
 
-void Interpreter::modifyCell(int delta) {
-    int newValue = memory[pointer] + delta;
+void Interpreter::modifyCell(int index, int delta) {
+    long long newValue = getCell(index) + delta;
 
     switch (cellBehavior) {
         case CellBehavior::WRAP:
-            memory[pointer] = ((newValue % 256) + 256) % 256;
-            break;
-
         case CellBehavior::UNLIMITED:
-            memory[pointer] = newValue;
+            writeCell(index, newValue);
             break;
 
         case CellBehavior::ERROR:
             if (newValue < 0) {
-                throw CellOverflowError("Cell underflow: attempted to set cell " + std::to_string(pointer) +
+                throw CellOverflowError("Cell underflow: attempted to set cell " + std::to_string(index) +
                                       " to " + std::to_string(newValue));
-            } else if (newValue > 255) {
-                throw CellOverflowError("Cell overflow: attempted to set cell " + std::to_string(pointer) +
+            } else if (newValue > cellMax()) {
+                throw CellOverflowError("Cell overflow: attempted to set cell " + std::to_string(index) +
                                       " to " + std::to_string(newValue));
             } else {
-                memory[pointer] = newValue;
+                writeCell(index, newValue);
             }
             break;
     }
 }
 
+int Interpreter::cellIndex(int offset) const {
+    int index = pointer + offset;
+    if (index >= 0 && index < memorySize) {
+        return index;
+    }
+
+    switch (pointerBehavior) {
+        case PointerBehavior::WRAP:
+            return ((index % memorySize) + memorySize) % memorySize;
+
+        case PointerBehavior::ERROR:
+        case PointerBehavior::UNBOUNDED:
+            if (index < 0) {
+                throw PointerOverflowError("Pointer underflow: attempted to access " + std::to_string(index));
+            }
+            throw PointerOverflowError("Pointer overflow: attempted to access " + std::to_string(index) +
+                                     " (max: " + std::to_string(memorySize - 1) + ")");
+
+        case PointerBehavior::CLAMP:
+        default:
+            return std::max(0, std::min(index, memorySize - 1));
+    }
+}
+
 std::vector<std::pair<int, char>> Interpreter::checkProgramSyntax() const {
-    std::set<char> allowed = {'[', ']', '.', ',', '<', '>', '+', '-'};
     std::vector<std::pair<int, char>> errors;
 
     for (size_t i = 0; i < program.size(); ++i) {
-        if (allowed.find(program[i]) == allowed.end()) {
-            errors.emplace_back(i, program[i]);
+        switch (program[i]) {
+            case '[': case ']': case '.': case ',': case '<': case '>': case '+': case '-':
+                break;
+            default:
+                errors.emplace_back(i, program[i]);
+                break;
         }
     }
 
     return errors;
 }
 
+std::string Interpreter::generateC() {
+    if (compiledProgram.empty()) {
+        compileProgram();
+    }
+    return CTranspiler::generate(compiledProgram, pointerBehavior, cellBehavior, cellWidth, memorySize);
+}
+
 std::string Interpreter::generatePseudocode() {
     std::ostringstream pseudocode;
     pseudocode << "Program loaded with " << program.size() << " characters.\n";
-    pseudocode << "Memory initialized with " << memory.size() << " cells.\n";
+    if (pointerBehavior == PointerBehavior::UNBOUNDED) {
+        pseudocode << "Memory grows on demand, up to " << memorySize << " cells.\n";
+    } else {
+        pseudocode << "Memory initialized with " << memorySize << " cells.\n";
+    }
     pseudocode << "Pointer initialized at position " << pointer << ".\n";
     pseudocode << "pointer = " << pointer << "\n\n";
 
+    const std::string range = "0-" + std::to_string(cellMax());
+    const std::string modulus = std::to_string(cellMax() + 1);
+
     std::string behaviorName;
     switch (cellBehavior) {
-        case CellBehavior::WRAP: behaviorName = "wrap around (0-255)"; break;
+        case CellBehavior::WRAP: behaviorName = "wrap around (" + range + ")"; break;
         case CellBehavior::UNLIMITED: behaviorName = "unlimited range"; break;
         case CellBehavior::ERROR: behaviorName = "error on overflow/underflow"; break;
     }
@@ -147,20 +465,20 @@ std::string Interpreter::generatePseudocode() {
                 break;
             case '+':
                 if (cellBehavior == CellBehavior::WRAP) {
-                    pseudocode << tabber << "memory[pointer] += 1 (mod 256)\n";
+                    pseudocode << tabber << "memory[pointer] += 1 (mod " << modulus << ")\n";
                 } else if (cellBehavior == CellBehavior::UNLIMITED) {
                     pseudocode << tabber << "memory[pointer] += 1 (unlimited)\n";
                 } else {
-                    pseudocode << tabber << "memory[pointer] += 1 (0-255, error on overflow)\n";
+                    pseudocode << tabber << "memory[pointer] += 1 (" << range << ", error on overflow)\n";
                 }
                 break;
             case '-':
                 if (cellBehavior == CellBehavior::WRAP) {
-                    pseudocode << tabber << "memory[pointer] -= 1 (mod 256)\n";
+                    pseudocode << tabber << "memory[pointer] -= 1 (mod " << modulus << ")\n";
                 } else if (cellBehavior == CellBehavior::UNLIMITED) {
                     pseudocode << tabber << "memory[pointer] -= 1 (unlimited)\n";
                 } else {
-                    pseudocode << tabber << "memory[pointer] -= 1 (0-255, error on underflow)\n";
+                    pseudocode << tabber << "memory[pointer] -= 1 (" << range << ", error on underflow)\n";
                 }
                 break;
             case '.':
@@ -170,7 +488,7 @@ std::string Interpreter::generatePseudocode() {
                 pseudocode << tabber << "memory[pointer] = input_char()\n";
                 break;
             case '[':
-                pseudocode << tabber << "while memory[pointer] != 0:\n";
+                pseudocode << tabber << "while getCell(pointer) != 0:\n";
                 tabber += "  ";
                 break;
             case ']':
@@ -187,7 +505,7 @@ std::string Interpreter::generatePseudocode() {
     return pseudocode.str();
 }
 
-std::vector<std::pair<char, int>> Interpreter::compileProgram() {
+std::vector<Instruction> Interpreter::compileProgram() {
     if (program.empty()) {
         throw std::runtime_error("No program loaded to compile.");
     }
@@ -202,341 +520,1290 @@ std::vector<std::pair<char, int>> Interpreter::compileProgram() {
         throw std::runtime_error(oss.str());
     }
 
-    std::stack<int> stack;
-    compiledProgram.clear();
-    int pc = 0;
-    int length = static_cast<int>(program.size());
-
-    while (pc < length) {
-        char cmd = program[pc];
-
-        if (cmd == '[') {
-            stack.push(static_cast<int>(compiledProgram.size()));
-            compiledProgram.emplace_back('[', -1);
-        } else if (cmd == ']') {
-            if (stack.empty()) {
-                throw std::runtime_error("Unmatched ']' found.");
+    stashCompiled();
+    CompileKey key = compileKey();
+    if (cachedSource.empty() || !(key == cachedKey) || !recompileChanged()) {
+        std::string cachePath = compileCachePath(key);
+        if (cachePath.empty() || !loadCompiled(cachePath)) {
+            std::vector<Instruction> ops;
+            std::vector<SourceRange> spans;
+            parseRange(0, static_cast<int>(program.size()), ops, spans);
+            compiledProgram = optimizationLevel == OptimizationLevel::IDIOMS ? optimizeLoops(ops) : ops;
+            sourceMap = mapSource(compiledProgram, spans);
+            if (!cachePath.empty()) {
+                storeCompiled(cachePath);
             }
-            int startIdx = stack.top();
-            stack.pop();
-            int endIdx = static_cast<int>(compiledProgram.size());
-            compiledProgram.emplace_back(']', startIdx);
-            compiledProgram[startIdx].second = endIdx;
-        } else if (cmd == '>' || cmd == '<' || cmd == '+' || cmd == '-') {
-
-            int count = 1;
-            while (pc + 1 < length && program[pc + 1] == cmd) {
-                count++;
-                pc++;
-            }
-            compiledProgram.emplace_back(cmd, count);
-        } else if (cmd == '.' || cmd == ',') {
-            compiledProgram.emplace_back(cmd, 0);
         }
-        pc++;
     }
 
-    if (!stack.empty()) {
-        throw std::runtime_error("Unmatched '[' found.");
-    }
+    // An empty result would leave the old program in the cache under the new source.
+    cachedSource = compiledProgram.empty() ? std::string() : program;
+    cachedKey = std::move(key);
 
+    discardJit();
     return compiledProgram;
 }
 
-int Interpreter::runProgramFast(int maxSteps) {
-    if (compiledProgram.empty()) {
-        compileProgram();
+// Whatever drops the compiled program hands it to the cache instead, which then
+// describes it until the next compile.
+void Interpreter::stashCompiled() {
+    compiledVersion++;
+    if (!compiledProgram.empty()) {
+        cachedProgram = std::move(compiledProgram);
+        cachedSourceMap = std::move(sourceMap);
     }
+    compiledProgram.clear();
+    sourceMap.clear();
+}
 
-    int pc = 0;
-    int steps = 0;
+Interpreter::CompileKey Interpreter::compileKey() const {
+    return {pointerBehavior, cellBehavior, memorySize, optimizationLevel, breakpoints};
+}
 
-    while (pc < static_cast<int>(compiledProgram.size()) && steps < maxSteps) {
-        const auto& [cmd, arg] = compiledProgram[pc];
+// Empty when the cache is off. The name hashes the source together with the key, so
+// any change to either lands on a different file.
+std::string Interpreter::compileCachePath(const CompileKey& key) const {
+    if (compileCacheDir.empty()) {
+        return std::string();
+    }
+    std::ostringstream text;
+    text << program << '\n' << static_cast<int>(key.pointerBehavior) << ' ' << static_cast<int>(key.cellBehavior)
+         << ' ' << key.memorySize << ' ' << static_cast<int>(key.optimizationLevel);
+    for (int offset : key.breakpoints) {
+        text << ' ' << offset;
+    }
+    return (std::filesystem::path(compileCacheDir) / ("bf_" + CTranspiler::hash(text.str()) + ".bfc")).string();
+}
 
-        try {
-            switch (cmd) {
-                case '>':
-                    movePointer(arg);
-                    break;
-                case '<':
-                    movePointer(-arg);
-                    break;
-                case '+':
-                    modifyCell(arg);
-                    break;
-                case '-':
-                    modifyCell(-arg);
-                    break;
-                case '.': {
-                    int cellValue = memory[pointer];
-                    if (cellBehavior == CellBehavior::UNLIMITED && (cellValue < 0 || cellValue > 255)) {
-                        char outputChar = static_cast<char>(std::max(0, std::min(255, cellValue)));
-                        outputBuffer += outputChar;
-                    } else {
-                        outputBuffer += static_cast<char>(cellValue % 256);
-                    }
-                    break;
-                }
-                case ',':
-                    if (!inputBuffer.empty()) {
-                        int inputValue = inputBuffer.front();
-                        inputBuffer.erase(inputBuffer.begin());
-                        if (cellBehavior == CellBehavior::ERROR && (inputValue < 0 || inputValue > 255)) {
-                            throw CellOverflowError("Input value " + std::to_string(inputValue) + " out of range (0-255)");
-                        }
-                        memory[pointer] = inputValue;
-                    } else if (inputCallback) {
-                        std::string inputData = inputCallback();
-                        if (!inputData.empty()) {
-                            for (char c : inputData) {
-                                inputBuffer.push_back(static_cast<int>(c));
-                            }
-                            if (!inputBuffer.empty()) {
-                                int inputValue = inputBuffer.front();
-                                inputBuffer.erase(inputBuffer.begin());
-                                if (cellBehavior == CellBehavior::ERROR && (inputValue < 0 || inputValue > 255)) {
-                                    throw CellOverflowError("Input value " + std::to_string(inputValue) + " out of range (0-255)");
-                                }
-                                memory[pointer] = inputValue;
-                            } else {
-                                memory[pointer] = 0;
-                            }
-                        } else {
-                            memory[pointer] = 0;
-                        }
-                    } else {
-                        memory[pointer] = 0;
-                    }
-                    break;
-                case '[':
-                    if (memory[pointer] == 0) {
-                        pc = arg;
-                    }
-                    break;
-                case ']':
-                    if (memory[pointer] != 0) {
-                        pc = arg;
-                    }
-                    break;
-            }
-        } catch (const PointerOverflowError&) {
-            throw;
-        } catch (const CellOverflowError&) {
-            throw;
+// Anything unexpected, from a missing file to a damaged one, is a miss. The entry
+// holds its source and settings, so a hash collision is a miss as well.
+bool Interpreter::loadCompiled(const std::string& path) {
+    try {
+        BytecodeFile file(path);
+        if (file.pointerBehavior() != pointerBehavior || file.cellBehavior() != cellBehavior ||
+            file.memorySize() != memorySize || file.optimizationLevel() != optimizationLevel ||
+            trapsOf(file) != breakpoints || file.source() != program) {
+            return false;
         }
-
-        pc++;
-        steps++;
+        compiledProgram.assign(file.instructions(), file.instructions() + file.size());
+        sourceMap.assign(file.sourceMap(), file.sourceMap() + file.size());
+        return true;
+    } catch (const std::runtime_error&) {
+        return false;
     }
-
-    running = false;
-    return steps;
 }
 
-bool Interpreter::runProgramFastInterruptible(int stepsPerChunk, int maxSteps) {
-    if (compiledProgram.empty()) {
-        compileProgram();
+// A cache that cannot be written is simply not used.
+void Interpreter::storeCompiled(const std::string& path) const {
+    try {
+        BytecodeFile::write(path, compiledProgram, sourceMap, program,
+                            pointerBehavior, cellBehavior, cellWidth, optimizationLevel, memorySize);
+    } catch (const std::runtime_error&) {
     }
+}
+
+// Compiles program[from, to) on its own. Loop targets are indices into ops, and the
+// range must not split a loop unless it is the whole program, where a stray bracket is
+// reported as usual.
+void Interpreter::parseRange(int from, int to, std::vector<Instruction>& ops,
+                             std::vector<SourceRange>& spans) const {
+    std::stack<int> stack;
+    int pc = from;
+    int length = to;
 
-    int chunkSteps = 0;
-    while (fastPc < static_cast<int>(compiledProgram.size()) &&
-           chunkSteps < stepsPerChunk &&
-           fastSteps < maxSteps) {
+    auto emit = [&](Instruction ins, int start, int end) {
+        ops.push_back(ins);
+        spans.push_back({start, end});
+    };
 
-        const auto& [cmd, arg] = compiledProgram[fastPc];
+    // Pointer moves are deferred and folded into the offsets of the ops that follow,
+    // so ">+>+<<" becomes two offset ADDs and no MOVE. Clamping is not additive at the
+    // tape edges, so CLAMP keeps every move in place.
+    bool fold = optimizationLevel != OptimizationLevel::NONE;
+    bool foldOffsets = fold && pointerBehavior != PointerBehavior::CLAMP;
+    int maxOffset = std::min<int>(INT16_MAX, memorySize - 1);
+    int pending = 0;
+    int moveStart = -1, moveEnd = -1;
+    int minVisited = 0, maxVisited = 0;
+    int minChecked = 0, maxChecked = 0;
 
-        try {
-            switch (cmd) {
-                case '>':
-                    movePointer(arg);
-                    break;
-                case '<':
-                    movePointer(-arg);
-                    break;
-                case '+':
-                    modifyCell(arg);
-                    break;
-                case '-':
-                    modifyCell(-arg);
-                    break;
-                case '.': {
-                    int cellValue = memory[pointer];
-                    if (cellBehavior == CellBehavior::UNLIMITED && (cellValue < 0 || cellValue > 255)) {
-                        char outputChar = static_cast<char>(std::max(0, std::min(255, cellValue)));
-                        outputBuffer += outputChar;
-                    } else {
-                        outputBuffer += static_cast<char>(cellValue % 256);
-                    }
-                    break;
-                }
-                case ',':
-                    if (!inputBuffer.empty()) {
-                        int inputValue = inputBuffer.front();
-                        inputBuffer.erase(inputBuffer.begin());
-                        if (cellBehavior == CellBehavior::ERROR && (inputValue < 0 || inputValue > 255)) {
-                            throw CellOverflowError("Input value " + std::to_string(inputValue) + " out of range (0-255)");
-                        }
-                        memory[pointer] = inputValue;
-                    } else if (inputCallback) {
-                        std::string inputData = inputCallback();
-                        if (!inputData.empty()) {
-                            for (char c : inputData) {
-                                inputBuffer.push_back(static_cast<int>(c));
-                            }
-                            if (!inputBuffer.empty()) {
-                                int inputValue = inputBuffer.front();
-                                inputBuffer.erase(inputBuffer.begin());
-                                if (cellBehavior == CellBehavior::ERROR && (inputValue < 0 || inputValue > 255)) {
-                                    throw CellOverflowError("Input value " + std::to_string(inputValue) + " out of range (0-255)");
-                                }
-                                memory[pointer] = inputValue;
-                            } else {
-                                memory[pointer] = 0;
-                            }
-                        } else {
-                            memory[pointer] = 0;
-                        }
-                    } else {
-                        memory[pointer] = 0;
-                    }
-                    break;
-                case '[':
-                    if (memory[pointer] == 0) {
-                        fastPc = arg;
-                    }
-                    break;
-                case ']':
-                    if (memory[pointer] != 0) {
-                        fastPc = arg;
-                    }
-                    break;
+    // ERROR must still fault on a cell the pointer passed over without touching it,
+    // so before the next access every unchecked extreme gets a zero ADD as a probe.
+    auto probe = [&]() {
+        if (pointerBehavior == PointerBehavior::ERROR || pointerBehavior == PointerBehavior::UNBOUNDED) {
+            if (minVisited < minChecked && minVisited != pending) {
+                emit({OpCode::ADD, static_cast<int16_t>(minVisited), 0}, pc, pc);
+            }
+            if (maxVisited > maxChecked && maxVisited != pending) {
+                emit({OpCode::ADD, static_cast<int16_t>(maxVisited), 0}, pc, pc);
             }
-        } catch (const PointerOverflowError&) {
-            throw;
-        } catch (const CellOverflowError&) {
-            throw;
         }
+        minChecked = minVisited;
+        maxChecked = maxVisited;
+    };
 
-        fastPc++;
-        fastSteps++;
-        chunkSteps++;
-    }
-
-    if (fastPc >= static_cast<int>(compiledProgram.size()) || fastSteps >= maxSteps) {
-        running = false;
-        fastPc = 0;
-        fastSteps = 0;
-        return false;
-    }
+    auto flushMove = [&]() {
+        probe();
+        if (pending != 0) {
+            emit({OpCode::MOVE, 0, pending}, moveStart, moveEnd);
+        }
+        pending = 0;
+        moveStart = moveEnd = -1;
+        minVisited = maxVisited = 0;
+        minChecked = maxChecked = 0;
+    };
 
-    return true;
-}
+    while (pc < length) {
+        char cmd = program[pc];
 
-bool Interpreter::step() {
-    if (!running || pc >= static_cast<int>(program.size())) {
-        running = false;
-        return false;
-    }
+        // A trap needs the state to match the source exactly, so nothing folds across it.
+        if (breakpoints.count(pc)) {
+            flushMove();
+            emit({OpCode::BREAK, 0, pc}, pc, pc);
+        }
 
-    char ch = program[pc];
+        int first = pc;
+        int count = 1;
+        if (fold && (cmd == '>' || cmd == '<' || cmd == '+' || cmd == '-')) {
+            while (pc + 1 < length && program[pc + 1] == cmd && !breakpoints.count(pc + 1)) {
+                count++;
+                pc++;
+            }
+        }
 
-    try {
-        switch (ch) {
+        switch (cmd) {
             case '>':
-                movePointer(1);
-                break;
-            case '<':
-                movePointer(-1);
+            case '<': {
+                int delta = cmd == '>' ? count : -count;
+                if (!foldOffsets || std::abs(delta) > maxOffset) {
+                    flushMove();
+                    emit({OpCode::MOVE, 0, delta}, first, pc + 1);
+                    break;
+                }
+                if (std::abs(pending + delta) > maxOffset) {
+                    flushMove();
+                }
+                if (moveStart < 0) {
+                    moveStart = first;
+                }
+                moveEnd = pc + 1;
+                pending += delta;
+                minVisited = std::min(minVisited, pending);
+                maxVisited = std::max(maxVisited, pending);
                 break;
+            }
             case '+':
-                modifyCell(1);
-                break;
-            case '-':
-                modifyCell(-1);
-                break;
-            case '.': {
-                int cellValue = memory[pointer];
-                if (cellBehavior == CellBehavior::UNLIMITED && (cellValue < 0 || cellValue > 255)) {
-                    char outputChar = static_cast<char>(std::max(0, std::min(255, cellValue)));
-                    outputBuffer += outputChar;
+            case '-': {
+                int delta = cmd == '+' ? count : -count;
+                probe();
+                Instruction* last = ops.empty() ? nullptr : &ops.back();
+                if (fold && last && last->op == OpCode::ADD && last->offset == pending &&
+                    (cellBehavior != CellBehavior::ERROR || (last->arg < 0) == (delta < 0))) {
+                    last->arg += delta;
+                    spans.back().end = pc + 1;
                 } else {
-                    outputBuffer += static_cast<char>(cellValue % 256);
+                    emit({OpCode::ADD, static_cast<int16_t>(pending), delta}, first, pc + 1);
                 }
                 break;
             }
+            case '.':
+                probe();
+                emit({OpCode::OUTPUT, static_cast<int16_t>(pending), 0}, pc, pc + 1);
+                break;
             case ',':
-                if (!inputBuffer.empty()) {
-                    int inputValue = inputBuffer.front();
-                    inputBuffer.erase(inputBuffer.begin());
-                    if (cellBehavior == CellBehavior::ERROR && (inputValue < 0 || inputValue > 255)) {
-                        throw CellOverflowError("Input value " + std::to_string(inputValue) + " out of range (0-255)");
-                    }
-                    memory[pointer] = inputValue;
-                } else if (inputCallback) {
-                    std::string inputData = inputCallback();
-                    if (!inputData.empty()) {
-                        for (char c : inputData) {
-                            inputBuffer.push_back(static_cast<int>(c));
-                        }
-                        if (!inputBuffer.empty()) {
-                            int inputValue = inputBuffer.front();
-                            inputBuffer.erase(inputBuffer.begin());
-                            if (cellBehavior == CellBehavior::ERROR && (inputValue < 0 || inputValue > 255)) {
-                                throw CellOverflowError("Input value " + std::to_string(inputValue) + " out of range (0-255)");
-                            }
-                            memory[pointer] = inputValue;
-                        } else {
-                            memory[pointer] = 0;
-                        }
-                    } else {
-                        memory[pointer] = 0;
-                    }
-                } else {
-                    memory[pointer] = 0;
-                }
+                probe();
+                emit({OpCode::INPUT, static_cast<int16_t>(pending), 0}, pc, pc + 1);
                 break;
             case '[':
-                if (memory[pointer] == 0) {
-                    int depth = 1;
-                    while (depth > 0) {
-                        pc++;
-                        if (pc >= static_cast<int>(program.size())) {
-                            throw std::runtime_error("Unmatched '[' found.");
-                        }
-                        if (program[pc] == '[') {
-                            depth++;
-                        } else if (program[pc] == ']') {
-                            depth--;
-                        }
-                    }
-                }
+                flushMove();
+                stack.push(static_cast<int>(ops.size()));
+                emit({OpCode::LOOP_START, 0, -1}, pc, pc + 1);
                 break;
-            case ']':
-                if (memory[pointer] != 0) {
-                    int depth = 1;
-                    while (depth > 0) {
-                        pc--;
-                        if (pc < 0) {
-                            throw std::runtime_error("Unmatched ']' found.");
-                        }
-                        if (program[pc] == ']') {
-                            depth++;
-                        } else if (program[pc] == '[') {
-                            depth--;
-                        }
-                    }
+            case ']': {
+                flushMove();
+                if (stack.empty()) {
+                    throw std::runtime_error("Unmatched ']' found.");
                 }
+                int startIdx = stack.top();
+                stack.pop();
+                int endIdx = static_cast<int>(ops.size());
+                emit({OpCode::LOOP_END, 0, startIdx}, pc, pc + 1);
+                ops[startIdx].arg = endIdx;
                 break;
+            }
         }
-    } catch (const PointerOverflowError&) {
-        throw;
-    } catch (const CellOverflowError&) {
-        throw;
+        pc++;
     }
 
-    pc++;
-    return true;
+    if (!stack.empty()) {
+        throw std::runtime_error("Unmatched '[' found.");
+    }
+    flushMove();
+}
+
+// optimizeLoops() keeps every op in order and only adds MUL_TERMs after a MULTIPLY,
+// so the spans line up again by skipping those. An idiom covers its whole loop.
+std::vector<SourceRange> Interpreter::mapSource(const std::vector<Instruction>& compiled,
+                                                const std::vector<SourceRange>& spans) {
+    std::vector<SourceRange> map;
+    map.reserve(compiled.size());
+    size_t next = 0;
+    for (const Instruction& ins : compiled) {
+        map.push_back(ins.op == OpCode::MUL_TERM ? map.back() : spans[next++]);
+    }
+    for (size_t i = 0; i < compiled.size(); ++i) {
+        OpCode op = compiled[i].op;
+        if (op == OpCode::CLEAR || op == OpCode::MULTIPLY || op == OpCode::SCAN) {
+            map[i].end = map[compiled[i].arg].end;
+        } else if (op == OpCode::MUL_TERM) {
+            map[i] = map[i - 1];
+        }
+    }
+    return map;
+}
+
+namespace {
+
+bool isBracket(char c) {
+    return c == '[' || c == ']';
+}
+
+bool isJump(OpCode op) {
+    return op == OpCode::LOOP_START || op == OpCode::LOOP_END || op == OpCode::CLEAR ||
+           op == OpCode::MULTIPLY || op == OpCode::SCAN;
+}
+
+// Whether source[first, last) holds whole loops only, and whether it holds any.
+bool balanced(const std::string& source, int first, int last, bool& hasLoops) {
+    int depth = 0;
+    hasLoops = false;
+    for (int i = first; i < last; ++i) {
+        if (isBracket(source[i])) {
+            hasLoops = true;
+            depth += source[i] == '[' ? 1 : -1;
+            if (depth < 0) {
+                return false;
+            }
+        }
+    }
+    return depth == 0;
+}
+
+}
+
+// Compiler state starts over after every bracket, so the source between two brackets
+// compiles to the same ops wherever it sits. An edit is widened to the smallest such
+// stretch that holds whole loops, in both the old and the new text, plus the loop around
+// it if that loop has no other loops inside: its body decides whether it becomes an
+// idiom. Only that stretch is compiled again; the ops around it are kept, with jump
+// targets and source offsets moved by the size change. Returns false when the edit
+// cannot be isolated, and the caller compiles everything.
+bool Interpreter::recompileChanged() {
+    const std::string& old = cachedSource;
+    const int oldLength = static_cast<int>(old.size());
+    const int length = static_cast<int>(program.size());
+    const int shift = length - oldLength;
+
+    int common = std::min(oldLength, length);
+    int prefix = 0;
+    while (prefix < common && old[prefix] == program[prefix]) {
+        prefix++;
+    }
+    int suffix = 0;
+    while (suffix < common - prefix && old[oldLength - 1 - suffix] == program[length - 1 - suffix]) {
+        suffix++;
+    }
+    if (prefix == length && prefix == oldLength) {
+        compiledProgram = std::move(cachedProgram);
+        sourceMap = std::move(cachedSourceMap);
+        return true;
+    }
+
+    int first = prefix;
+    while (first > 0 && !isBracket(program[first - 1])) {
+        first--;
+    }
+    int last = length - suffix;
+    while (last < length && !isBracket(program[last])) {
+        last++;
+    }
+
+    while (true) {
+        bool loops = false;
+        bool oldLoops = false;
+        bool whole = balanced(program, first, last, loops) && balanced(old, first, last - shift, oldLoops);
+        bool innermost = first > 0 && last < length && program[first - 1] == '[' && program[last] == ']' &&
+                         (!loops || !oldLoops);
+        if (whole && !innermost) {
+            break;
+        }
+        if (first == 0 && last == length) {
+            return false;
+        }
+        if (first > 0) {
+            for (first--; first > 0 && !isBracket(program[first - 1]); first--) {}
+        }
+        if (last < length) {
+            for (last++; last < length && !isBracket(program[last]); last++) {}
+        }
+    }
+
+    // A breakpoint after the edit sits at the same offset in both texts, so the kept
+    // traps would be off by the shift.
+    if (shift != 0 && breakpoints.lower_bound(std::min(last, last - shift)) != breakpoints.end()) {
+        return false;
+    }
+
+    // The ops of the stretch start after those of the bracket before it, and end before
+    // those of the bracket after it, or of a trap on that bracket.
+    const int size = static_cast<int>(cachedProgram.size());
+    auto bracketOp = [&](int offset, int from) {
+        while (!(isJump(cachedProgram[from].op) && cachedSourceMap[from].start == offset)) {
+            from++;
+        }
+        return from;
+    };
+    int from = 0;
+    if (first > 0) {
+        from = bracketOp(first - 1, 0) + 1;
+        while (from < size && cachedProgram[from].op == OpCode::MUL_TERM) {
+            from++;
+        }
+    }
+    int to = size;
+    if (last < length) {
+        to = bracketOp(last - shift, from);
+        while (to > from && cachedProgram[to - 1].op == OpCode::BREAK && cachedProgram[to - 1].arg == last - shift) {
+            to--;
+        }
+    }
+
+    std::vector<Instruction> ops;
+    std::vector<SourceRange> spans;
+    parseRange(first, last, ops, spans);
+    std::vector<Instruction> stretch = optimizationLevel == OptimizationLevel::IDIOMS ? optimizeLoops(ops) : ops;
+    std::vector<SourceRange> stretchMap = mapSource(stretch, spans);
+
+    for (Instruction& ins : stretch) {
+        if (isJump(ins.op)) {
+            ins.arg += from;
+        }
+    }
+
+    const int delta = static_cast<int>(stretch.size()) - (to - from);
+    compiledProgram = std::move(cachedProgram);
+    sourceMap = std::move(cachedSourceMap);
+    compiledProgram.erase(compiledProgram.begin() + from, compiledProgram.begin() + to);
+    compiledProgram.insert(compiledProgram.begin() + from, stretch.begin(), stretch.end());
+    sourceMap.erase(sourceMap.begin() + from, sourceMap.begin() + to);
+    sourceMap.insert(sourceMap.begin() + from, stretchMap.begin(), stretchMap.end());
+
+    // Jumps into the ops after the stretch move with them, and those ops' source
+    // offsets with the text.
+    for (int i = 0; i < from; ++i) {
+        if (isJump(compiledProgram[i].op) && compiledProgram[i].arg >= to) {
+            compiledProgram[i].arg += delta;
+        }
+    }
+    for (int i = from + static_cast<int>(stretch.size()); i < static_cast<int>(compiledProgram.size()); ++i) {
+        Instruction& ins = compiledProgram[i];
+        if (isJump(ins.op) && ins.arg >= to) {
+            ins.arg += delta;
+        } else if (ins.op == OpCode::BREAK) {
+            ins.arg += shift;
+        }
+        sourceMap[i].start += shift;
+        sourceMap[i].end += shift;
+    }
+    return true;
+}
+
+// Idiom ops replace the LOOP_START of a recognized loop and keep the original body and
+// LOOP_END behind them. When the fast path cannot reproduce the configured semantics
+// exactly (cell range, tape edge, non-terminating loop) the op falls into the body.
+std::vector<Instruction> Interpreter::optimizeLoops(const std::vector<Instruction>& ops) const {
+    std::vector<Instruction> out;
+    out.reserve(ops.size());
+    std::stack<int> stack;
+
+    for (int i = 0; i < static_cast<int>(ops.size()); ++i) {
+        const Instruction& ins = ops[i];
+
+        if (ins.op == OpCode::LOOP_START) {
+            if (emitLoopIdiom(ops, i, ins.arg, out)) {
+                i = ins.arg;
+                continue;
+            }
+            stack.push(static_cast<int>(out.size()));
+            out.push_back({OpCode::LOOP_START, 0, -1});
+        } else if (ins.op == OpCode::LOOP_END) {
+            int startIdx = stack.top();
+            stack.pop();
+            int endIdx = static_cast<int>(out.size());
+            out.push_back({OpCode::LOOP_END, 0, startIdx});
+            out[startIdx].arg = endIdx;
+        } else {
+            out.push_back(ins);
+        }
+    }
+
+    return out;
+}
+
+bool Interpreter::emitLoopIdiom(const std::vector<Instruction>& ops, int start, int end,
+                                std::vector<Instruction>& out) const {
+    if (end - start < 2) {
+        return false;
+    }
+
+    int pos = 0;
+    int minPos = 0;
+    int maxPos = 0;
+    std::map<int, int> deltas;
+    std::set<int> rising, falling;
+
+    for (int i = start + 1; i < end; ++i) {
+        const Instruction& ins = ops[i];
+        int at = pos;
+
+        if (ins.op == OpCode::MOVE) {
+            pos += ins.arg;
+            at = pos;
+        } else if (ins.op == OpCode::ADD) {
+            at = pos + ins.offset;
+            deltas[at] += ins.arg;
+            (ins.arg < 0 ? falling : rising).insert(at);
+        } else {
+            return false;
+        }
+
+        minPos = std::min(minPos, at);
+        maxPos = std::max(maxPos, at);
+    }
+
+    if (minPos < INT16_MIN || maxPos > INT16_MAX) {
+        return false;
+    }
+
+    int headerIdx = static_cast<int>(out.size());
+
+    if (deltas.empty()) {
+        if (end - start != 2) {
+            return false;
+        }
+        out.push_back({OpCode::SCAN, static_cast<int16_t>(pos), -1});
+    } else {
+        if (pos != 0) {
+            return false;
+        }
+
+        // ERROR checks only the final value of each target, which is exact as long as
+        // no cell both rises and falls within one iteration.
+        if (cellBehavior == CellBehavior::ERROR) {
+            for (int at : rising) {
+                if (falling.count(at)) {
+                    return false;
+                }
+            }
+        }
+
+        int step = deltas.count(0) ? deltas[0] : 0;
+        if (step != -1 && !(step == 1 && cellBehavior == CellBehavior::WRAP)) {
+            return false;
+        }
+
+        if (deltas.size() == 1 && minPos == 0 && maxPos == 0) {
+            out.push_back({OpCode::CLEAR, 0, -1});
+        } else {
+            deltas.erase(0);
+            deltas.emplace(minPos, 0);
+            deltas.emplace(maxPos, 0);
+
+            out.push_back({OpCode::MULTIPLY, 0, -1});
+            out.push_back({OpCode::MUL_TERM, 0, step});
+            for (const auto& [offset, delta] : deltas) {
+                out.push_back({OpCode::MUL_TERM, static_cast<int16_t>(offset), delta});
+            }
+        }
+    }
+
+    int bodyStart = static_cast<int>(out.size());
+    for (int i = start + 1; i < end; ++i) {
+        out.push_back(ops[i]);
+    }
+
+    int endIdx = static_cast<int>(out.size());
+    out.push_back({OpCode::LOOP_END, 0, bodyStart - 1});
+    out[headerIdx].arg = endIdx;
+
+    return true;
+}
+
+bool Interpreter::runClearLoop(int pc) {
+    long long value = getCell(pointer);
+    int step = compiledProgram[pc + 1].arg;
+
+    if (cellBehavior != CellBehavior::WRAP && (step > 0 ? value > 0 : value < 0)) {
+        return false;
+    }
+
+    writeCell(pointer, 0);
+    return true;
+}
+
+bool Interpreter::runMultiplyLoop(int pc) {
+    const Instruction* terms = &compiledProgram[pc + 1];
+    long long value = getCell(pointer);
+
+    long long iterations;
+    if (terms[0].arg == -1 && value > 0) {
+        iterations = value;
+    } else if (terms[0].arg == 1 && cellBehavior == CellBehavior::WRAP) {
+        iterations = cellMax() + 1 - value;
+    } else {
+        return false;
+    }
+
+    for (const Instruction* term = terms + 1; term->op == OpCode::MUL_TERM; ++term) {
+        int index = pointer + term->offset;
+        if (index < 0 || index >= memorySize) {
+            return false;
+        }
+        if (cellBehavior == CellBehavior::ERROR) {
+            // Anything this large is out of range anyway; leave it to the loop to report.
+            if (std::llabs(term->arg) > (1LL << 33) / iterations) {
+                return false;
+            }
+            long long result = getCell(index) + iterations * term->arg;
+            if (result < 0 || result > cellMax()) {
+                return false;
+            }
+        }
+    }
+
+    for (const Instruction* term = terms + 1; term->op == OpCode::MUL_TERM; ++term) {
+        if (term->arg == 0) {
+            continue;
+        }
+        int index = pointer + term->offset;
+        if (cellBehavior == CellBehavior::WRAP) {
+            uint64_t product = static_cast<uint64_t>(iterations) * static_cast<uint64_t>(static_cast<long long>(term->arg));
+            writeCell(index, static_cast<long long>(static_cast<uint64_t>(getCell(index)) + product));
+        } else {
+            writeCell(index, getCell(index) + iterations * term->arg);
+        }
+    }
+
+    writeCell(pointer, 0);
+    return true;
+}
+
+bool Interpreter::runScanLoop(int pc) {
+    int stride = compiledProgram[pc].offset;
+    int p = pointer;
+
+    while (getCell(p) != 0) {
+        int next = p + stride;
+        if (next < 0 || next >= memorySize) {
+            break;
+        }
+        p = next;
+    }
+
+    pointer = p;
+    return getCell(p) == 0;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MB_COMPUTED_GOTO 1
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#else
+#define MB_COMPUTED_GOTO 0
+#endif
+
+// Each handler jumps straight to the next one, so every opcode gets its own indirect
+// branch. The step budget is only checked on backward jumps, which bounds any overshoot
+// by the length of one branch-free run.
+//
+// The loop is instantiated once per pointer behavior, cell behavior and cell type, so the
+// hot ops compile down to plain arithmetic on a register-held pointer with only the checks
+// that mode needs, and WRAP cells wrap natively through their width. Anything unusual (a
+// tape edge, an overflow) goes through the generic helpers to produce the same result
+// and message as the other engines.
+template <PointerBehavior P, CellBehavior C, typename T>
+int Interpreter::runThreaded(int& pc, int maxSteps) {
+    const Instruction* code = compiledProgram.data();
+    const int size = static_cast<int>(compiledProgram.size());
+    const unsigned tapeSize = static_cast<unsigned>(memorySize);
+    T* mem = cells<T>();
+    int ptr = pointer;
+    int ip = pc;
+    int steps = 0;
+
+    if (ip >= size || maxSteps <= 0) {
+        return 0;
+    }
+
+    auto at = [&](int offset) {
+        int index = ptr + offset;
+        if (static_cast<unsigned>(index) < tapeSize) {
+            return index;
+        }
+        pointer = ptr;
+        return cellIndex(offset);
+    };
+
+#if MB_COMPUTED_GOTO
+    static void* const handlers[] = {
+        &&op_ADD, &&op_MOVE, &&op_OUTPUT, &&op_INPUT, &&op_LOOP_START,
+        &&op_LOOP_END, &&op_CLEAR, &&op_MULTIPLY, &&op_MUL_TERM, &&op_SCAN, &&op_BREAK
+    };
+#define OP(name) op_##name:
+#define DISPATCH() goto *handlers[static_cast<uint8_t>(code[ip].op)]
+#define NEXT() do { ++ip; ++steps; if (ip >= size) goto done; DISPATCH(); } while (0)
+#else
+#define OP(name) case OpCode::name:
+#define NEXT() do { ++ip; ++steps; if (ip >= size) goto done; goto dispatch; } while (0)
+#endif
+
+    try {
+#if MB_COMPUTED_GOTO
+        DISPATCH();
+#else
+    dispatch:
+        switch (code[ip].op) {
+#endif
+        OP(ADD) {
+            int index = at(code[ip].offset);
+            if constexpr (C == CellBehavior::WRAP) {
+                mem[index] = static_cast<T>(mem[index] + static_cast<T>(code[ip].arg));
+            } else if constexpr (C == CellBehavior::UNLIMITED) {
+                mem[index] += code[ip].arg;
+            } else {
+                long long value = static_cast<long long>(mem[index]) + code[ip].arg;
+                if (value < 0 || value > static_cast<long long>(std::numeric_limits<T>::max())) {
+                    pointer = ptr;
+                    modifyCell(index, code[ip].arg);
+                }
+                mem[index] = static_cast<T>(value);
+            }
+            NEXT();
+        }
+        OP(MOVE) {
+            int next = ptr + code[ip].arg;
+            if (static_cast<unsigned>(next) >= tapeSize) {
+                if constexpr (P == PointerBehavior::CLAMP) {
+                    next = next < 0 ? 0 : memorySize - 1;
+                } else {
+                    pointer = ptr;
+                    movePointer(code[ip].arg);
+                    next = pointer;
+                }
+            }
+            ptr = next;
+            NEXT();
+        }
+        OP(OUTPUT)
+            if constexpr (C == CellBehavior::UNLIMITED) {
+                outputCell(at(code[ip].offset));
+            } else {
+                output->put(static_cast<char>(mem[at(code[ip].offset)]));
+            }
+            NEXT();
+        OP(INPUT)
+            inputCell(at(code[ip].offset));
+            NEXT();
+        OP(LOOP_START)
+            if (mem[ptr] == 0) {
+                ip = code[ip].arg;
+            }
+            NEXT();
+        OP(LOOP_END)
+            if (mem[ptr] != 0) {
+                ip = code[ip].arg;
+                if (steps >= maxSteps) {
+                    ++ip;
+                    ++steps;
+                    goto done;
+                }
+            }
+            NEXT();
+        OP(CLEAR)
+            if (mem[ptr] == 0) {
+                ip = code[ip].arg;
+            } else if constexpr (C == CellBehavior::WRAP) {
+                mem[ptr] = 0;
+                ip = code[ip].arg;
+            } else {
+                pointer = ptr;
+                if (runClearLoop(ip)) {
+                    ip = code[ip].arg;
+                }
+            }
+            NEXT();
+        OP(MULTIPLY)
+            pointer = ptr;
+            if (mem[ptr] == 0 || runMultiplyLoop(ip)) {
+                ip = code[ip].arg;
+            } else {
+                while (code[ip + 1].op == OpCode::MUL_TERM) {
+                    ip++;
+                }
+            }
+            NEXT();
+        OP(MUL_TERM)
+            NEXT();
+        OP(SCAN)
+            pointer = ptr;
+            if (mem[ptr] == 0 || runScanLoop(ip)) {
+                ip = code[ip].arg;
+            }
+            ptr = pointer;
+            NEXT();
+        OP(BREAK)
+            ++ip;
+            ++steps;
+            goto done;
+#if !MB_COMPUTED_GOTO
+        }
+#endif
+    } catch (...) {
+        pc = ip;
+        pointer = ptr;
+        throw;
+    }
+
+done:
+    pc = ip;
+    pointer = ptr;
+    return steps;
+
+#undef OP
+#undef NEXT
+#if MB_COMPUTED_GOTO
+#undef DISPATCH
+#endif
+}
+
+#if MB_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+template <PointerBehavior P, CellBehavior C>
+int Interpreter::runThreaded(int& pc, int maxSteps) {
+    switch (cellWidth) {
+        case CellWidth::BITS_8: return runThreaded<P, C, uint8_t>(pc, maxSteps);
+        case CellWidth::BITS_16: return runThreaded<P, C, uint16_t>(pc, maxSteps);
+        case CellWidth::BITS_32: return runThreaded<P, C, uint32_t>(pc, maxSteps);
+    }
+    return 0;
+}
+
+template <PointerBehavior P>
+int Interpreter::runThreaded(int& pc, int maxSteps) {
+    switch (cellBehavior) {
+        case CellBehavior::WRAP: return runThreaded<P, CellBehavior::WRAP>(pc, maxSteps);
+        case CellBehavior::UNLIMITED: return runThreaded<P, CellBehavior::UNLIMITED, int>(pc, maxSteps);
+        case CellBehavior::ERROR: return runThreaded<P, CellBehavior::ERROR>(pc, maxSteps);
+    }
+    return 0;
+}
+
+int Interpreter::runThreaded(int& pc, int maxSteps) {
+    switch (pointerBehavior) {
+        case PointerBehavior::CLAMP: return runThreaded<PointerBehavior::CLAMP>(pc, maxSteps);
+        case PointerBehavior::WRAP: return runThreaded<PointerBehavior::WRAP>(pc, maxSteps);
+        // Past the edge UNBOUNDED is ERROR on a much larger tape.
+        case PointerBehavior::ERROR:
+        case PointerBehavior::UNBOUNDED: return runThreaded<PointerBehavior::ERROR>(pc, maxSteps);
+    }
+    return 0;
+}
+
+void Interpreter::outputCell(int index) {
+    long long cellValue = getCell(index);
+    if (cellBehavior == CellBehavior::UNLIMITED && (cellValue < 0 || cellValue > 255)) {
+        char outputChar = static_cast<char>(std::max(0LL, std::min(255LL, cellValue)));
+        output->put(outputChar);
+    } else {
+        output->put(static_cast<char>(cellValue % 256));
+    }
+}
+
+void Interpreter::inputCell(int index) {
+    // Anything that may block on the user should see the prompt first.
+    if (!input || !input->buffered()) {
+        output->flush();
+    }
+
+    int inputValue = 0;
+    bool available = false;
+
+    // After a restore(), what was read past the snapshot is read again first.
+    const long long logged = inputCursor - inputLogStart;
+    if (logged >= 0 && logged < static_cast<long long>(inputLog.size())) {
+        inputValue = static_cast<int>(inputLog[logged]);
+        available = true;
+    } else {
+        available = input && input->read(inputValue);
+        if (!available && inputCallback) {
+            std::string inputData = inputCallback();
+            if (!inputData.empty()) {
+                input = std::make_unique<StringInput>(std::move(inputData));
+                available = input->read(inputValue);
+            }
+        }
+        if (available && loggingInput) {
+            inputLog.push_back(static_cast<char>(inputValue));
+        }
+    }
+
+    if (!available) {
+        writeCell(index, 0);
+        return;
+    }
+    inputCursor++;
+    if (cellBehavior == CellBehavior::ERROR && (inputValue < 0 || inputValue > cellMax())) {
+        throw CellOverflowError("Input value " + std::to_string(inputValue) + " out of range (0-" + std::to_string(cellMax()) + ")");
+    }
+    writeCell(index, inputValue);
+}
+
+void Interpreter::executeInstruction(int& pc) {
+    const Instruction& ins = compiledProgram[pc];
+
+    switch (ins.op) {
+        case OpCode::ADD:
+            modifyCell(cellIndex(ins.offset), ins.arg);
+            break;
+        case OpCode::MOVE:
+            movePointer(ins.arg);
+            break;
+        case OpCode::OUTPUT:
+            outputCell(cellIndex(ins.offset));
+            break;
+        case OpCode::INPUT:
+            inputCell(cellIndex(ins.offset));
+            break;
+        case OpCode::LOOP_START:
+            if (getCell(pointer) == 0) {
+                pc = ins.arg;
+            }
+            break;
+        case OpCode::LOOP_END:
+            if (getCell(pointer) != 0) {
+                pc = ins.arg;
+            }
+            break;
+        case OpCode::CLEAR:
+            if (getCell(pointer) == 0 || runClearLoop(pc)) {
+                pc = ins.arg;
+            }
+            break;
+        case OpCode::MULTIPLY:
+            if (getCell(pointer) == 0 || runMultiplyLoop(pc)) {
+                pc = ins.arg;
+            } else {
+                while (compiledProgram[pc + 1].op == OpCode::MUL_TERM) {
+                    pc++;
+                }
+            }
+            break;
+        case OpCode::MUL_TERM:
+            break;
+        case OpCode::SCAN:
+            if (getCell(pointer) == 0 || runScanLoop(pc)) {
+                pc = ins.arg;
+            }
+            break;
+        case OpCode::BREAK:
+            break;
+    }
+
+    pc++;
+}
+
+int Interpreter::runJit(int& pc, int maxSteps) {
+    if (!jit) {
+        jit = std::make_unique<JitCompiler>(*this);
+        if (dispatchMode == DispatchMode::C_MODULE) {
+            jitFailed = !jit->compileC(nativeCacheDir);
+        } else {
+            jitFailed = !jit->compile();
+        }
+    }
+    if (jitFailed) {
+        return runThreaded(pc, maxSteps);
+    }
+    return jit->run(pc, maxSteps);
+}
+
+int Interpreter::runDispatch(int& pc, int maxSteps) {
+    switch (dispatchMode) {
+        case DispatchMode::THREADED:
+            return runThreaded(pc, maxSteps);
+        case DispatchMode::JIT:
+            if (JitCompiler::isSupported()) {
+                return runJit(pc, maxSteps);
+            }
+            return runThreaded(pc, maxSteps);
+        case DispatchMode::C_MODULE:
+            return runJit(pc, maxSteps);
+        case DispatchMode::SWITCH:
+            break;
+    }
+
+    // Like the other engines, give up the budget only on a backward jump, so a run
+    // always stops where the source position is exact.
+    const int size = static_cast<int>(compiledProgram.size());
+    int steps = 0;
+    while (pc < size) {
+        int from = pc;
+        OpCode op = compiledProgram[pc].op;
+        executeInstruction(pc);
+        steps++;
+        if (op == OpCode::BREAK || (pc <= from && steps >= maxSteps)) {
+            break;
+        }
+    }
+    return steps;
+}
+
+long long Interpreter::runProgramFast(long long maxSteps) {
+    if (compiledProgram.empty()) {
+        compileProgram();
+    }
+
+    // The engines count steps in an int, so long runs go through in slices.
+    FlushOutput flush{*output};
+    markDirty(0, memorySize - 1);
+    dropHistory();
+    const int size = static_cast<int>(compiledProgram.size());
+    int pc = 0;
+    long long steps = 0;
+    while (pc < size && steps < maxSteps) {
+        steps += runDispatch(pc, static_cast<int>(std::min<long long>(maxSteps - steps, INT_MAX)));
+    }
+
+    // Still running only if maxSteps cut it short; a program can end on its last step.
+    running = pc < size;
+    return steps;
+}
+
+bool Interpreter::runProgramFastInterruptible(int stepsPerChunk, int maxSteps) {
+    if (compiledProgram.empty()) {
+        compileProgram();
+    }
+
+    FlushOutput flush{*output};
+    markDirty(0, memorySize - 1);
+    dropHistory();
+    if (fastPc < 0) {
+        fastPc = resumeIndex();
+    }
+
+    int ran = 0;
+    int budget = std::min(stepsPerChunk, maxSteps - fastSteps);
+    if (budget > 0) {
+        ran = runDispatch(fastPc, budget);
+        fastSteps += ran;
+    }
+
+    // Every engine stops only where sourceOffsetOf() is exact, so pc follows the run and
+    // a later step() carries on from the same state.
+    breakpointHit = ran > 0 && compiledProgram[fastPc - 1].op == OpCode::BREAK
+                        ? compiledProgram[fastPc - 1].arg : -1;
+    int offset = sourceOffsetOf(fastPc);
+    if (offset >= 0) {
+        pc = offset;
+    }
+
+    // The step count stays readable until the next loadProgram() or reset(). A trap on
+    // the last op still pauses first, the next call finishes the run.
+    bool ended = fastPc >= static_cast<int>(compiledProgram.size()) && breakpointHit < 0;
+    if (ended || fastSteps >= maxSteps) {
+        running = false;
+        fastPc = 0;
+        return false;
+    }
+
+    return true;
+}
+
+// The source offset whose state the compiled program has reached before running
+// compiledProgram[index], or -1 where the two differ (pending pointer moves were folded
+// into later offsets). Loop heads and traps are preceded by a flushed move, so they and
+// whatever follows a loop head, a loop end or a trap line up with the source.
+int Interpreter::sourceOffsetOf(int index) const {
+    const int size = static_cast<int>(compiledProgram.size());
+    if (index <= 0) {
+        return 0;
+    }
+    if (compiledProgram[index - 1].op == OpCode::BREAK) {
+        return sourceMap[index - 1].start;
+    }
+    if (index >= size) {
+        return static_cast<int>(program.size());
+    }
+
+    switch (compiledProgram[index].op) {
+        case OpCode::LOOP_START:
+        case OpCode::CLEAR:
+        case OpCode::MULTIPLY:
+        case OpCode::SCAN:
+        case OpCode::BREAK:
+            return sourceMap[index].start;
+        default:
+            break;
+    }
+
+    switch (compiledProgram[index - 1].op) {
+        case OpCode::LOOP_END:
+            return sourceMap[index - 1].end;
+        case OpCode::LOOP_START:
+        case OpCode::CLEAR:
+        case OpCode::MULTIPLY:
+        case OpCode::MUL_TERM:
+        case OpCode::SCAN:
+            return sourceMap[index - 1].start + 1;
+        default:
+            return -1;
+    }
+}
+
+// After step() or a recompile the compiled position is stale. Single-step the source
+// up to the next offset the compiled program can take over from, which is at most the
+// next bracket or breakpoint. A trap at the offset we are already paused on is skipped.
+int Interpreter::resumeIndex() {
+    const int size = static_cast<int>(compiledProgram.size());
+    std::vector<int> indexAt(program.size() + 1, -1);
+    for (int i = size; i >= 0; --i) {
+        int offset = sourceOffsetOf(i);
+        if (offset >= 0) {
+            indexAt[offset] = i;
+        }
+    }
+
+    int hit = breakpointHit;
+    while (indexAt[pc] < 0 && step()) {
+    }
+
+    // Only a trap on the last op leaves the end of the source unmapped.
+    int index = indexAt[pc] < 0 ? size : indexAt[pc];
+    if (index < size && compiledProgram[index].op == OpCode::BREAK && hit == pc) {
+        index++;
+    }
+    return index;
+}
+
+// Matching bracket of every '[' and ']' for step(), -1 where there is none, built on
+// the first step after a load. An unmatched bracket is only an error once step() has
+// to jump from it.
+void Interpreter::buildBracketTable() {
+    bracketMatch.assign(program.size(), -1);
+    std::stack<int> open;
+    for (int i = 0; i < static_cast<int>(program.size()); ++i) {
+        if (program[i] == '[') {
+            open.push(i);
+        } else if (program[i] == ']' && !open.empty()) {
+            bracketMatch[i] = open.top();
+            bracketMatch[open.top()] = i;
+            open.pop();
+        }
+    }
+}
+
+bool Interpreter::step() {
+    if (!running || pc >= static_cast<int>(program.size())) {
+        running = false;
+        return false;
+    }
+
+    if (bracketMatch.size() != program.size()) {
+        buildBracketTable();
+    }
+
+    char ch = program[pc];
+    FlushOutput flush{*output};
+    fastPc = -1;
+    breakpointHit = -1;
+
+    const int from = pc;
+    const long long readBefore = inputCursor;
+    uint32_t before = 0;
+    if (recordingSteps) {
+        if (checkpoints.empty() || historySteps - checkpoints.back().step >= CHECKPOINT_INTERVAL) {
+            takeCheckpoint();
+        }
+        before = ch == '<' || ch == '>' ? static_cast<uint32_t>(pointer) : static_cast<uint32_t>(getCell(pointer));
+    }
+
+    try {
+        switch (ch) {
+            case '>':
+                movePointer(1);
+                break;
+            case '<':
+                movePointer(-1);
+                break;
+            case '+':
+                modifyCell(pointer, 1);
+                markDirty(pointer, pointer);
+                break;
+            case '-':
+                modifyCell(pointer, -1);
+                markDirty(pointer, pointer);
+                break;
+            case '.':
+                outputCell(pointer);
+                break;
+            case ',':
+                inputCell(pointer);
+                markDirty(pointer, pointer);
+                break;
+            case '[':
+                if (getCell(pointer) == 0) {
+                    if (bracketMatch[pc] < 0) {
+                        throw std::runtime_error("Unmatched '[' found.");
+                    }
+                    pc = bracketMatch[pc];
+                }
+                break;
+            case ']':
+                if (getCell(pointer) != 0) {
+                    if (bracketMatch[pc] < 0) {
+                        throw std::runtime_error("Unmatched ']' found.");
+                    }
+                    pc = bracketMatch[pc];
+                }
+                break;
+        }
+    } catch (const PointerOverflowError&) {
+        throw;
+    } catch (const CellOverflowError&) {
+        throw;
+    }
+
+    pc++;
+
+    if (recordingSteps) {
+        history.push_back({static_cast<uint32_t>(from), inputCursor != readBefore, before});
+        historySteps++;
+        if (history.size() > MAX_HISTORY) {
+            auto next = std::upper_bound(checkpoints.begin(), checkpoints.end(), historyStart,
+                                         [](long long step, const Checkpoint& c) { return step < c.step; });
+            if (next != checkpoints.end() && next->step < historySteps) {
+                history.erase(history.begin(), history.begin() + (next->step - historyStart));
+                historyStart = next->step;
+            }
+        }
+    }
+    return true;
+}
+
+void Interpreter::setStepHistory(bool enabled) {
+    recordingSteps = enabled;
+    dropHistory();
+}
+
+void Interpreter::dropHistory() {
+    history.clear();
+    checkpoints.clear();
+    historySteps = 0;
+    historyStart = 0;
+}
+
+// Checkpoints older than the records thin out with age: replaying from one never takes
+// longer than the gap to the next, and the gaps only grow where nobody steps back often.
+void Interpreter::takeCheckpoint() {
+    checkpoints.push_back({historySteps, snapshot()});
+    if (checkpoints.size() <= MAX_CHECKPOINTS) {
+        return;
+    }
+    std::vector<Checkpoint> kept;
+    for (size_t i = 0; i < checkpoints.size(); ++i) {
+        if (i % 2 == 0 || checkpoints[i].step >= historyStart) {
+            kept.push_back(std::move(checkpoints[i]));
+        }
+    }
+    checkpoints = std::move(kept);
+}
+
+// The records before historyStart were dropped: goes back to the checkpoint before it and
+// steps forward again, which records them anew. Input comes back from the input log.
+bool Interpreter::replaySegment() {
+    auto from = std::lower_bound(checkpoints.begin(), checkpoints.end(), historySteps,
+                                 [](const Checkpoint& c, long long step) { return c.step < step; });
+    if (from == checkpoints.begin()) {
+        return false;
+    }
+    --from;
+
+    // Replaying prints the output since the checkpoint again, so it has to go first.
+    if (!output->truncate(from->state.outputCursor)) {
+        return false;
+    }
+    const long long target = historySteps;
+    checkpoints.erase(from + 1, checkpoints.end());
+    restoreState(checkpoints.back().state);
+    historySteps = historyStart = checkpoints.back().step;
+    while (historySteps < target && step()) {
+    }
+    return !history.empty();
+}
+
+bool Interpreter::stepBack() {
+    if (history.empty() && !replaySegment()) {
+        return false;
+    }
+
+    const StepRecord record = history.back();
+    FlushOutput flush{*output};
+    // A byte the sink has already passed on stays printed, so the step stays done too.
+    if (program[record.pc] == '.' && !output->truncate(output->cursor() - 1)) {
+        return false;
+    }
+    history.pop_back();
+    historySteps--;
+    // Checkpoints past here are taken again on the way forward.
+    while (checkpoints.back().step > historySteps) {
+        checkpoints.pop_back();
+    }
+
+    pc = static_cast<int>(record.pc);
+    switch (program[pc]) {
+        case '>':
+        case '<':
+            pointer = static_cast<int>(record.before);
+            break;
+        case ',':
+            if (record.consumedInput) {
+                inputCursor--;
+            }
+            [[fallthrough]];
+        case '+':
+        case '-':
+            writeCell(pointer, record.before);
+            markDirty(pointer, pointer);
+            break;
+    }
+
+    running = true;
+    fastPc = -1;
+    breakpointHit = -1;
+    return true;
+}
+
+long long Interpreter::runBackward(const std::set<int>& offsets) {
+    long long steps = 0;
+    while (stepBack()) {
+        steps++;
+        if (offsets.count(pc)) {
+            break;
+        }
+    }
+    return steps;
 }
 
 int Interpreter::runUntilEnd(int maxSteps) {
@@ -4,15 +4,22 @@
 
 
 #include <vector>
+#include <deque>
 #include <string>
 #include <functional>
 #include <stdexcept>
 #include <memory>
+#include <set>
+#include <cstdint>
+#include "Tape.h"
+#include "InputSource.h"
+#include "OutputSink.h"
 
 enum class PointerBehavior {
-    CLAMP = 0,  // Stay at boundaries
-    WRAP = 1,   // Wrap around
-    ERROR = 2   // Raise exception
+    CLAMP = 0,    // Stay at boundaries
+    WRAP = 1,     // Wrap around
+    ERROR = 2,    // Raise exception
+    UNBOUNDED = 3 // Grow to the right on demand, raise exception below cell 0
 };
 
 enum class CellBehavior {
@@ -21,6 +28,25 @@ enum class CellBehavior {
     ERROR = 2      // Raise exception on underflow/overflow
 };
 
+enum class CellWidth {
+    BITS_8 = 0,  // uint8_t cells (0-255)
+    BITS_16 = 1, // uint16_t cells (0-65535)
+    BITS_32 = 2  // uint32_t cells (0-4294967295)
+};
+
+enum class DispatchMode {
+    SWITCH = 0,  // One switch per instruction
+    THREADED = 1, // Computed-goto threaded dispatch (switch fallback without GCC/Clang)
+    JIT = 2,      // Native x86-64 code (threaded dispatch on other targets)
+    C_MODULE = 3  // Transpiled to C, built with cc and loaded with dlopen (threaded past 4096 ops)
+};
+
+enum class OptimizationLevel {
+    NONE = 0,  // One instruction per source character
+    FOLD = 1,  // Runs of +-<> merged, pointer moves folded into offsets
+    IDIOMS = 2 // FOLD plus clear, multiply and scan loops
+};
+
 class PointerOverflowError : public std::runtime_error {
 public:
     explicit PointerOverflowError(const std::string& message)
@@ -33,55 +59,293 @@ public:
         : std::runtime_error(message) {}
 };
 
+enum class OpCode : uint8_t {
+    ADD,        // memory[pointer + offset] += arg
+    MOVE,       // pointer += arg
+    OUTPUT,     // print memory[pointer + offset]
+    INPUT,      // memory[pointer + offset] = next input value
+    LOOP_START, // jump to arg if memory[pointer] == 0
+    LOOP_END,   // jump to arg if memory[pointer] != 0
+    CLEAR,      // [-] / [+]: memory[pointer] = 0, then jump to arg
+    MULTIPLY,   // [->+<]: apply the MUL_TERMs that follow, then jump to arg
+    MUL_TERM,   // memory[pointer + offset] += iterations * arg
+    SCAN,       // [>] / [<<]: move by offset until memory[pointer] == 0, then jump to arg
+    BREAK       // breakpoint on source offset arg: stop the engine, resume after it
+};
+
+struct Instruction {
+    OpCode op;
+    int16_t offset;
+    int32_t arg;
+};
+
+static_assert(sizeof(Instruction) == 8, "Instruction should stay packed into 8 bytes");
+
+// The characters program[start, end) that an instruction was compiled from.
+struct SourceRange {
+    int start;
+    int end;
+};
+
+// Cells [first, last] that may have changed, empty when first > last.
+struct CellRange {
+    int first;
+    int last;
+};
+
+// A run's state as Interpreter::snapshot() took it. Copies are cheap, since the tape is
+// shared page by page with the interpreter and with other snapshots.
+struct InterpreterSnapshot {
+    TapeImage tape;
+    int pointer = 0;
+    int pc = 0;
+    bool running = false;
+    int fastPc = 0;
+    int fastSteps = 0;
+    int breakpointHit = -1;
+    size_t outputCursor = 0;
+    long long inputCursor = 0;
+    long long session = -1;
+    long long compiledVersion = -1;
+};
+
+class JitCompiler;
+
 class Interpreter {
+    friend class JitCompiler;
+
     private:
-        std::vector<int> memory;
+        Tape memory;
         std::string program;
-        std::string outputBuffer;
-        std::vector<int> inputBuffer;
-        std::vector<std::pair<char, int>> compiledProgram;
+        std::unique_ptr<OutputSink> output;
+        std::unique_ptr<InputSource> input;
+        std::vector<Instruction> compiledProgram;
+        std::vector<int> bracketMatch;
+        std::vector<SourceRange> sourceMap;
+        std::set<int> breakpoints;
 
+        int configuredSize;
         int memorySize;
         int pointer;
         int pc;
         bool running;
         int fastPc;
         int fastSteps;
+        int breakpointHit;
+        CellRange dirty;
+
+        // For snapshot(): the tape as of the last snapshot() or restore() and the cells
+        // written since, and every input byte read since the first snapshot, which
+        // restore() hands out again before reading on. session changes with each load,
+        // reset and new tape, compiledVersion whenever the compiled program is dropped.
+        CellRange unsaved;
+        TapeImage savedTape;
+        std::string inputLog;
+        long long inputLogStart;
+        long long inputCursor;
+        bool loggingInput;
+        long long session;
+        long long compiledVersion;
+
+        // For stepBack(): what each step() since the history began overwrote, and a
+        // snapshot every CHECKPOINT_INTERVAL steps. Past MAX_HISTORY records the oldest
+        // go, a checkpoint at a time, and stepping back that far replays them from the
+        // checkpoint before; past MAX_CHECKPOINTS every other old checkpoint goes.
+        // The pointer is the cell index: it is the same before and after + - and ,.
+        struct StepRecord {
+            uint32_t pc : 31;
+            uint32_t consumedInput : 1;
+            uint32_t before; // The pointer for < and >, the cell for + - and ,
+        };
+        struct Checkpoint {
+            long long step;
+            InterpreterSnapshot state;
+        };
+        static constexpr long long CHECKPOINT_INTERVAL = 1 << 16;
+        static constexpr size_t MAX_HISTORY = 1 << 22;
+        static constexpr size_t MAX_CHECKPOINTS = 256;
+
+        bool recordingSteps;
+        long long historySteps;
+        long long historyStart;
+        std::deque<StepRecord> history;
+        std::vector<Checkpoint> checkpoints;
 
         PointerBehavior pointerBehavior;
         CellBehavior cellBehavior;
+        CellWidth cellWidth;
+        DispatchMode dispatchMode;
+        OptimizationLevel optimizationLevel;
+        std::unique_ptr<JitCompiler> jit;
+        bool jitFailed;
+        std::string nativeCacheDir;
+        std::string compileCacheDir;
         std::function<std::string()> inputCallback;
 
+        // What a compile depends on besides the source.
+        struct CompileKey {
+            PointerBehavior pointerBehavior;
+            CellBehavior cellBehavior;
+            int memorySize;
+            OptimizationLevel optimizationLevel;
+            std::set<int> breakpoints;
+
+            bool operator==(const CompileKey&) const = default;
+        };
+
+        // The last compile and what it was built from; the program itself sits in
+        // compiledProgram until something drops it. reset() and loadProgram() keep it,
+        // so the next compileProgram() only redoes the loops an edit touched.
+        std::string cachedSource;
+        CompileKey cachedKey;
+        std::vector<Instruction> cachedProgram;
+        std::vector<SourceRange> cachedSourceMap;
+
+        // UNLIMITED cells are always a plain int, the other behaviors store cellWidth.
+        enum class CellType { U8, U16, U32, INT };
+
+        CellType cellType() const;
+        int cellBytes() const;
+        long long cellMax() const;
+        template <typename T>
+        T* cells() const { return reinterpret_cast<T*>(memory.data()); }
+        void allocateTape();
+        void writeCell(int index, long long value);
+        void markDirty(int first, int last);
+
         void movePointer(int delta);
-        void modifyCell(int delta);
+        void modifyCell(int index, int delta);
+        int cellIndex(int offset) const;
+        void outputCell(int index);
+        void inputCell(int index);
+
+        void restoreState(const InterpreterSnapshot& snapshot);
+        void dropHistory();
+        void takeCheckpoint();
+        bool replaySegment();
+
+        CompileKey compileKey() const;
+        void parseRange(int from, int to, std::vector<Instruction>& ops, std::vector<SourceRange>& spans) const;
+        static std::vector<SourceRange> mapSource(const std::vector<Instruction>& compiled,
+                                                  const std::vector<SourceRange>& spans);
+        bool recompileChanged();
+        void stashCompiled();
+        std::string compileCachePath(const CompileKey& key) const;
+        bool loadCompiled(const std::string& path);
+        void storeCompiled(const std::string& path) const;
+        std::vector<Instruction> optimizeLoops(const std::vector<Instruction>& ops) const;
+        bool emitLoopIdiom(const std::vector<Instruction>& ops, int start, int end,
+                           std::vector<Instruction>& out) const;
+        bool runClearLoop(int pc);
+        bool runMultiplyLoop(int pc);
+        bool runScanLoop(int pc);
+        void buildBracketTable();
+        int sourceOffsetOf(int index) const;
+        int resumeIndex();
+        void executeInstruction(int& pc);
+        void discardJit();
+        int runJit(int& pc, int maxSteps);
+        int runDispatch(int& pc, int maxSteps);
+        int runThreaded(int& pc, int maxSteps);
+        template <PointerBehavior P>
+        int runThreaded(int& pc, int maxSteps);
+        template <PointerBehavior P, CellBehavior C>
+        int runThreaded(int& pc, int maxSteps);
+        template <PointerBehavior P, CellBehavior C, typename T>
+        int runThreaded(int& pc, int maxSteps);
 
     public:
         explicit Interpreter(int memorySize = 30000);
+        ~Interpreter();
 
-        void configure(PointerBehavior ptrBehavior, CellBehavior cellBehavior);
+        void configure(PointerBehavior ptrBehavior, CellBehavior cellBehavior,
+                       CellWidth cellWidth = CellWidth::BITS_8);
         void reset();
         void loadProgram(const std::string& program, const std::string& inputData = "");
+        // A .bfc file (see BytecodeFile.h) holds the compiled program with its source and
+        // settings. saveBytecode() compiles first if needed; loadBytecode() stands in for
+        // configure(), loadProgram() and compileProgram() without parsing anything. Both
+        // throw std::runtime_error on a file they cannot use.
+        void saveBytecode(const std::string& path);
+        void loadBytecode(const std::string& path, const std::string& inputData = "");
         void setInputCallback(std::function<std::string()> callback);
+        // Replaces whatever input loadProgram() supplied; the callback still takes over once it runs dry.
+        void setInputSource(std::unique_ptr<InputSource> source);
+        // Kept across reset() and loadProgram(), which only clear it. Defaults to an unbounded BufferOutput.
+        void setOutputSink(std::unique_ptr<OutputSink> sink);
+        void setDispatchMode(DispatchMode mode);
+        // Applies from the next compile; step() always walks the source directly.
+        void setOptimizationLevel(OptimizationLevel level);
+        // Where C_MODULE keeps built modules; empty (the default) means
+        // $XDG_CACHE_HOME/mindboggler or ~/.cache/mindboggler. A directory someone else owns
+        // or can write to is refused, and the run falls back to threaded dispatch.
+        void setNativeCacheDir(const std::string& dir) { nativeCacheDir = dir; }
+        // Where compileProgram() keeps compiled programs between runs, keyed by the
+        // source and every setting the compile depends on. Empty (the default) turns it off.
+        void setCompileCacheDir(const std::string& dir) { compileCacheDir = dir; }
+        // Source offsets the compiled engines stop at. A change recompiles, and a run in
+        // progress picks up where it is.
+        void setBreakpoints(const std::set<int>& offsets);
 
         std::vector<std::pair<int, char>> checkProgramSyntax() const;
         std::string generatePseudocode();
-        std::vector<std::pair<char, int>> compileProgram();
+        std::string generateC();
+        std::vector<Instruction> compileProgram();
 
-        int runProgramFast(int maxSteps = 1000000);
+        // Runs from the start; isRunning() afterwards says whether maxSteps stopped it.
+        long long runProgramFast(long long maxSteps = 1000000);
+        // Also returns after a breakpoint trap, with getPc() on the breakpoint and
+        // getBreakpointHit() set. runProgramFast() runs straight through them.
         bool runProgramFastInterruptible(int stepsPerChunk = 10000, int maxSteps = 1000000);
         bool step();
         int runUntilEnd(int maxSteps = 1000000);
+        // With the history on, step() keeps an undo log that stepBack() walks back one
+        // step at a time and runBackward() until pc sits on one of `offsets`, returning
+        // the steps taken. Both stop, changing nothing, where the history starts and at a
+        // '.' whose byte the sink has already passed on (FileOutput, CallbackOutput), since
+        // stepping forward again would print it twice. The history starts over with each
+        // load, reset, configure(), restore() and fast run, so only stepping since then
+        // can be taken back.
+        void setStepHistory(bool enabled);
+        bool stepBack();
+        long long runBackward(const std::set<int>& offsets);
+        bool canStepBack() const { return historySteps > 0; }
 
         // Getters
         int getPointer() const { return pointer; }
         int getPc() const { return pc; }
         bool isRunning() const { return running; }
-        const std::vector<int>& getMemory() const { return memory; }
-        const std::string& getOutputBuffer() const { return outputBuffer; }
+        long long getCell(int index) const;
+        // Cells written since the last call. step() reports the cell it touched, while
+        // a fast run or a new tape reports the whole tape.
+        CellRange takeDirtyCells();
+
+        // Captures pc, pointer, tape, the output and input cursors and the step counters.
+        // Only the pages written since the previous snapshot or restore are compared (the
+        // whole tape after a fast run), and only those that changed are copied.
+        InterpreterSnapshot snapshot();
+        // Goes back to a snapshot of the current load. Output printed since is taken back
+        // and input read since is read again. Returns false, changing nothing, when the
+        // sink can't bring the output to where the snapshot had it: bytes that already
+        // left a file or callback sink, or a later snapshot than the output has reached
+        // after restoring an earlier one. Throws std::runtime_error for a snapshot taken
+        // before the last load, reset or reconfigured tape.
+        bool restore(const InterpreterSnapshot& snapshot);
+        const std::string& getOutputBuffer() const { return output->text(); }
+        // The output cursor: everything printed since reset() is numbered from 0, so a
+        // caller can fetch just what is new with readOutputSince(lastCursor, out).
+        size_t getOutputCursor() const { return output->end(); }
+        size_t readOutputSince(size_t offset, std::string& out) const { return output->readSince(offset, out); }
+        OutputSink& getOutputSink() const { return *output; }
         int getMemorySize() const { return memorySize; }
         int getFastSteps() const { return fastSteps; }
+        int getBreakpointHit() const { return breakpointHit; }
+        const std::vector<SourceRange>& getSourceMap() const { return sourceMap; }
         PointerBehavior getPointerBehavior() const { return pointerBehavior; }
         CellBehavior getCellBehavior() const { return cellBehavior; }
+        CellWidth getCellWidth() const { return cellWidth; }
+        DispatchMode getDispatchMode() const { return dispatchMode; }
+        OptimizationLevel getOptimizationLevel() const { return optimizationLevel; }
 };
 
 
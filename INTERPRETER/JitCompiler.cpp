@@ -0,0 +1,863 @@
+#include "JitCompiler.h"
+#include "CTranspiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define MB_JIT_X86_64 1
+#include <sys/mman.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <mutex>
+#include <type_traits>
+#else
+#define MB_JIT_X86_64 0
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MB_DLOPEN 1
+#include <cerrno>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#else
+#define MB_DLOPEN 0
+#endif
+
+// The generated code keeps the tape base in rbx, the pointer in r12, the context in r13
+// and the remaining step budget in r14. Cells are addressed with the tape's own width,
+// so WRAP arithmetic wraps natively. It only handles the in-range case: before each
+// straight run of ADD/MOVE/OUTPUT/INPUT it checks that every cell the run touches is on
+// the tape, and anything else (a tape edge, an ERROR-mode overflow) exits with the
+// instruction index so the host can execute that one instruction in the interpreter
+// and re-enter. Every mode therefore behaves exactly like the other engines.
+//
+// In ERROR and UNBOUNDED pointer modes, where leaving the tape ends the program, the
+// range checks become plain loads of the outermost cells instead. If those land in the
+// tape's guard pages the fault handler resumes at the run's deopt exit, and the
+// interpreter raises the error. Modes that run into the edges routinely keep the
+// compares, since a fault costs far more than a branch.
+//
+// Steps are counted the way the threaded loop counts them, one per op run. A straight
+// run is charged as a whole at its end and every other op as it starts, so a deopt exit
+// charges the part of its run that did execute, and re-entering in the middle of a run
+// credits back the part that didn't.
+
+namespace {
+
+enum JitExit {
+    EXIT_END = 0,    // Ran off the end of the program
+    EXIT_BUDGET = 1, // Step budget used up on a backward jump
+    EXIT_DEOPT = 2,  // Instruction at ip needs the interpreter
+    EXIT_ERROR = 3,  // A callback threw, the exception is pending
+    EXIT_BREAK = 4   // Hit a breakpoint trap, ip is the op after it
+};
+
+#if MB_JIT_X86_64
+
+thread_local JitCompiler* runningJit = nullptr;
+
+struct sigaction previousSegv;
+struct sigaction previousBus;
+
+void onFault(int signal, siginfo_t* info, void* context) {
+    if (JitCompiler::recoverFault(info->si_addr, context)) {
+        return;
+    }
+    const struct sigaction& previous = signal == SIGBUS ? previousBus : previousSegv;
+    if (previous.sa_flags & SA_SIGINFO) {
+        previous.sa_sigaction(signal, info, context);
+    } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+        previous.sa_handler(signal);
+    } else {
+        // Returning re-runs the faulting instruction, which now takes the default action.
+        sigaction(signal, &previous, nullptr);
+    }
+}
+
+void installFaultHandler() {
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        struct sigaction action = {};
+        action.sa_sigaction = &onFault;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previousSegv);
+        sigaction(SIGBUS, &action, &previousBus);
+    });
+}
+
+enum Condition : uint8_t {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_GE = 0xD
+};
+
+enum Register : uint8_t {
+    RAX = 0, RCX = 1, RDX = 2
+};
+
+class Assembler {
+    public:
+        std::vector<uint8_t> code;
+
+        size_t size() const { return code.size(); }
+
+        void bytes(std::initializer_list<uint8_t> values) {
+            code.insert(code.end(), values);
+        }
+
+        void imm32(int32_t value) {
+            for (int i = 0; i < 4; ++i) {
+                code.push_back(static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * i)));
+            }
+        }
+
+        void imm64(uint64_t value) {
+            for (int i = 0; i < 8; ++i) {
+                code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        void patch(size_t at, size_t target) {
+            int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+            std::memcpy(&code[at], &rel, sizeof(rel));
+        }
+
+        // Returns the position of the rel32 to patch.
+        size_t jcc(Condition cc) {
+            bytes({0x0F, static_cast<uint8_t>(0x80 | cc)});
+            imm32(0);
+            return size() - 4;
+        }
+
+        size_t jmp() {
+            bytes({0xE9});
+            imm32(0);
+            return size() - 4;
+        }
+
+        explicit Assembler(int cellBytes) : cellBytes(cellBytes) {}
+
+        // opcode /reg with [rbx + r12*cellBytes + offset*cellBytes], using byteOpcode for
+        // 8-bit cells and opcode (with an operand-size prefix for 16-bit cells) otherwise.
+        void cell(uint8_t byteOpcode, uint8_t opcode, uint8_t reg, int offset) {
+            if (cellBytes == 2) {
+                bytes({0x66});
+            }
+            bytes({0x42, cellBytes == 1 ? byteOpcode : opcode});
+            cellAddress(reg, offset);
+        }
+
+        void cellImm(int32_t value) {
+            if (cellBytes == 4) {
+                imm32(value);
+                return;
+            }
+            bytes({static_cast<uint8_t>(value)});
+            if (cellBytes == 2) {
+                bytes({static_cast<uint8_t>(value >> 8)});
+            }
+        }
+
+        // mov/movzx reg, cell
+        void loadCell(uint8_t reg, int offset) {
+            if (cellBytes == 4) {
+                bytes({0x42, 0x8B});
+            } else {
+                bytes({0x42, 0x0F, static_cast<uint8_t>(cellBytes == 1 ? 0xB6 : 0xB7)});
+            }
+            cellAddress(reg, offset);
+        }
+
+        void cmpCellZero(int offset) {
+            cell(0x80, 0x83, 7, offset);
+            bytes({0x00});
+        }
+
+        // lea reg, [r12 + delta]; cmp reg, tapeSize
+        void checkIndex(Register reg, long long delta, int tapeSize) {
+            bytes({0x49, 0x8D, static_cast<uint8_t>(0x84 | (reg << 3)), 0x24});
+            imm32(static_cast<int32_t>(delta));
+            bytes({0x48, 0x81, static_cast<uint8_t>(0xF8 | reg)});
+            imm32(tapeSize);
+        }
+
+        void call(const void* function) {
+            bytes({0x4C, 0x89, 0xEF});              // mov rdi, r13
+            bytes({0x48, 0xB8});                    // mov rax, function
+            imm64(reinterpret_cast<uint64_t>(function));
+            bytes({0xFF, 0xD0});                    // call rax
+        }
+
+        // mov esi, pc; mov edx, r12d
+        void loopArguments(int pc) {
+            bytes({0xBE});
+            imm32(pc);
+            bytes({0x44, 0x89, 0xE2});
+        }
+
+    private:
+        int cellBytes;
+
+        void cellAddress(uint8_t reg, int offset) {
+            uint8_t scale = cellBytes == 1 ? 0x00 : cellBytes == 2 ? 0x40 : 0x80;
+            bytes({static_cast<uint8_t>(0x84 | (reg << 3)), static_cast<uint8_t>(scale | 0x23)});
+            imm32(offset * cellBytes);
+        }
+};
+
+#endif
+
+}
+
+JitCompiler::JitCompiler(Interpreter& interp)
+    : interp(interp), code(nullptr), codeSize(0), module(nullptr), enter(nullptr) {
+}
+
+JitCompiler::~JitCompiler() {
+#if MB_JIT_X86_64
+    if (code) {
+        munmap(code, codeSize);
+    }
+#endif
+#if MB_DLOPEN
+    if (module) {
+        dlclose(module);
+    }
+#endif
+}
+
+bool JitCompiler::isSupported() {
+    return MB_JIT_X86_64;
+}
+
+bool JitCompiler::canLoadModules() {
+    return MB_DLOPEN;
+}
+
+bool JitCompiler::isStraightOp(OpCode op) {
+    return op == OpCode::ADD || op == OpCode::MOVE || op == OpCode::OUTPUT || op == OpCode::INPUT;
+}
+
+void JitCompiler::straightReach(const std::vector<Instruction>& program,
+                                std::vector<long long>& low, std::vector<long long>& high) {
+    const long long limit = 1LL << 30;
+    const int size = static_cast<int>(program.size());
+    low.assign(size + 1, 0);
+    high.assign(size + 1, 0);
+
+    for (int i = size - 1; i >= 0; --i) {
+        const Instruction& ins = program[i];
+        if (!isStraightOp(ins.op)) {
+            continue;
+        }
+        long long lo = 0;
+        long long hi = 0;
+        long long shift = 0;
+        if (ins.op == OpCode::MOVE) {
+            shift = ins.arg;
+        } else {
+            lo = std::min<long long>(0, ins.offset);
+            hi = std::max<long long>(0, ins.offset);
+        }
+        if (i + 1 < size && isStraightOp(program[i + 1].op)) {
+            lo = std::min(lo, low[i + 1] + shift);
+            hi = std::max(hi, high[i + 1] + shift);
+        }
+        low[i] = std::max(std::min(lo, shift), -limit);
+        high[i] = std::min(std::max(hi, shift), limit);
+    }
+}
+
+void JitCompiler::flushOutput(JitContext* ctx) {
+    JitCompiler* self = static_cast<JitCompiler*>(ctx->owner);
+    self->interp.output->append(ctx->output, static_cast<size_t>(ctx->outputLength));
+    ctx->outputLength = 0;
+}
+
+int JitCompiler::readInput(JitContext* ctx, int index) {
+    JitCompiler* self = static_cast<JitCompiler*>(ctx->owner);
+    flushOutput(ctx);
+    try {
+        self->interp.inputCell(index);
+    } catch (...) {
+        self->pendingError = std::current_exception();
+        return 1;
+    }
+    return 0;
+}
+
+int JitCompiler::clearLoop(JitContext* ctx, int pc, int pointer) {
+    JitCompiler* self = static_cast<JitCompiler*>(ctx->owner);
+    self->interp.pointer = pointer;
+    return self->interp.runClearLoop(pc);
+}
+
+int JitCompiler::multiplyLoop(JitContext* ctx, int pc, int pointer) {
+    JitCompiler* self = static_cast<JitCompiler*>(ctx->owner);
+    self->interp.pointer = pointer;
+    return self->interp.runMultiplyLoop(pc);
+}
+
+bool JitCompiler::recoverFault(const void* address, void* context) {
+#if MB_JIT_X86_64
+    JitCompiler* self = runningJit;
+    if (!self || self->probes.empty() || !self->interp.memory.isGuard(address)) {
+        return false;
+    }
+
+#if defined(__APPLE__)
+    auto& rip = static_cast<ucontext_t*>(context)->uc_mcontext->__ss.__rip;
+#else
+    auto& rip = static_cast<ucontext_t*>(context)->uc_mcontext.gregs[REG_RIP];
+#endif
+    const uintptr_t at = static_cast<uintptr_t>(rip) - reinterpret_cast<uintptr_t>(self->code);
+    if (at >= self->codeSize) {
+        return false;
+    }
+    auto probe = std::lower_bound(self->probes.begin(), self->probes.end(),
+                                  std::make_pair(static_cast<uint32_t>(at), 0u));
+    if (probe == self->probes.end() || probe->first != at) {
+        return false;
+    }
+    rip = static_cast<std::remove_reference_t<decltype(rip)>>(reinterpret_cast<uintptr_t>(self->code) + probe->second);
+    return true;
+#else
+    (void)address;
+    (void)context;
+    return false;
+#endif
+}
+
+bool JitCompiler::compile() {
+#if MB_JIT_X86_64
+    const std::vector<Instruction>& program = interp.compiledProgram;
+    const int size = static_cast<int>(program.size());
+    const int tapeSize = interp.memorySize;
+    const CellBehavior cells = interp.cellBehavior;
+    const int cellBytes = interp.cellBytes();
+    const bool probing = interp.pointerBehavior == PointerBehavior::ERROR ||
+                         interp.pointerBehavior == PointerBehavior::UNBOUNDED;
+    const long long probeBelow = probing ? static_cast<long long>(interp.memory.guardBelow() / cellBytes) : 0;
+    const long long probeAbove = probing ? static_cast<long long>(interp.memory.guardAbove() / cellBytes) : 0;
+
+    std::vector<long long> reachLow;
+    std::vector<long long> reachHigh;
+    straightReach(program, reachLow, reachHigh);
+
+    // The first op of the straight run each op is in.
+    std::vector<int> runStart(size + 1);
+    for (int i = 0; i <= size; ++i) {
+        bool midRun = i > 0 && i < size && isStraightOp(program[i].op) && isStraightOp(program[i - 1].op);
+        runStart[i] = midRun ? runStart[i - 1] : i;
+    }
+
+    struct Exit {
+        size_t at;
+        int ip;
+        int reason;
+    };
+
+    Assembler a(cellBytes);
+    std::vector<size_t> start(size + 1);
+    std::vector<std::pair<size_t, int>> jumps;
+    std::vector<Exit> exits;
+    std::vector<std::pair<size_t, int>> faults;
+
+    // The pointer is on the tape whenever a check runs, so reaching a cell within the
+    // guard distance either succeeds or faults on the guard. Out of range, the compare
+    // jumps to fallback, or deopts at ip when there is none.
+    auto check = [&](long long delta, int ip, int fallback) {
+        if (delta < 0 ? -delta <= probeBelow : delta <= probeAbove) {
+            faults.push_back({a.size(), ip});
+            a.loadCell(RCX, static_cast<int>(delta));                   // probe
+            return;
+        }
+        a.checkIndex(RCX, delta, tapeSize);
+        if (fallback < 0) {
+            exits.push_back({a.jcc(CC_AE), ip, EXIT_DEOPT});
+        } else {
+            jumps.push_back({a.jcc(CC_AE), fallback});
+        }
+    };
+
+    auto charge = [&](int steps) {
+        if (steps != 0) {
+            a.bytes({0x41, 0x81, 0xEE});                                // sub r14d, steps
+            a.imm32(steps);
+        }
+    };
+
+    auto guard = [&](int i) {
+        if (reachLow[i] < 0) {
+            check(reachLow[i], i, -1);
+        }
+        if (reachHigh[i] > 0) {
+            check(reachHigh[i], i, -1);
+        }
+    };
+
+    // Prologue: save callee-saved registers, load state and jump to the entry point.
+    a.bytes({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+    a.bytes({0x48, 0x83, 0xEC, 0x08});                                  // sub rsp, 8
+    a.bytes({0x49, 0x89, 0xFD});                                        // mov r13, rdi
+    a.bytes({0x49, 0x8B, 0x9D});                                        // mov rbx, [r13 + memory]
+    a.imm32(offsetof(JitContext, memory));
+    a.bytes({0x4D, 0x63, 0xA5});                                        // movsxd r12, [r13 + pointer]
+    a.imm32(offsetof(JitContext, pointer));
+    a.bytes({0x45, 0x8B, 0xB5});                                        // mov r14d, [r13 + budget]
+    a.imm32(offsetof(JitContext, budget));
+    a.bytes({0x41, 0xFF, 0xA5});                                        // jmp [r13 + entry]
+    a.imm32(offsetof(JitContext, entry));
+
+    for (int i = 0; i < size; ++i) {
+        const Instruction& ins = program[i];
+        start[i] = a.size();
+
+        if (isStraightOp(ins.op) && (i == 0 || !isStraightOp(program[i - 1].op))) {
+            guard(i);
+        }
+        if (!isStraightOp(ins.op) && ins.op != OpCode::MUL_TERM && ins.op != OpCode::BREAK) {
+            charge(1);
+        }
+
+        switch (ins.op) {
+            case OpCode::ADD:
+                if (cells == CellBehavior::ERROR) {
+                    a.loadCell(RAX, ins.offset);                        // rax = cell
+                    a.bytes({0x48, 0x05});                              // add rax, arg
+                    a.imm32(ins.arg);
+                    a.bytes({0xB9});                                    // mov ecx, max
+                    a.imm32(static_cast<int32_t>(static_cast<uint32_t>(interp.cellMax())));
+                    a.bytes({0x48, 0x39, 0xC8});                        // cmp rax, rcx
+                    exits.push_back({a.jcc(CC_A), i, EXIT_DEOPT});
+                    a.cell(0x88, 0x89, RAX, ins.offset);                // mov cell, eax
+                } else {
+                    a.cell(0x80, 0x81, 0, ins.offset);                  // add cell, arg (wraps natively)
+                    a.cellImm(ins.arg);
+                }
+                break;
+            case OpCode::MOVE:
+                a.bytes({0x49, 0x81, 0xC4});                            // add r12, arg
+                a.imm32(ins.arg);
+                break;
+            case OpCode::OUTPUT: {
+                a.loadCell(RAX, ins.offset);
+                if (cells == CellBehavior::UNLIMITED) {
+                    a.bytes({0x31, 0xC9, 0x85, 0xC0, 0x0F, 0x48, 0xC1});   // clamp below at 0
+                    a.bytes({0xB9, 0xFF, 0x00, 0x00, 0x00});
+                    a.bytes({0x39, 0xC8, 0x0F, 0x4F, 0xC1});               // clamp above at 255
+                }
+                a.bytes({0x41, 0x8B, 0x8D});                            // mov ecx, [r13 + outputLength]
+                a.imm32(offsetof(JitContext, outputLength));
+                a.bytes({0x41, 0x88, 0x84, 0x0D});                      // mov [r13 + rcx + output], al
+                a.imm32(offsetof(JitContext, output));
+                a.bytes({0x83, 0xC1, 0x01});                            // add ecx, 1
+                a.bytes({0x41, 0x89, 0x8D});                            // mov [r13 + outputLength], ecx
+                a.imm32(offsetof(JitContext, outputLength));
+                a.bytes({0x81, 0xF9});                                  // cmp ecx, capacity
+                a.imm32(sizeof(JitContext::output));
+                size_t roomLeft = a.jcc(CC_B);
+                a.call(reinterpret_cast<const void*>(&JitCompiler::flushOutput));
+                a.patch(roomLeft, a.size());
+                break;
+            }
+            case OpCode::INPUT:
+                a.bytes({0x49, 0x8D, 0x84, 0x24});                      // lea rax, [r12 + offset]
+                a.imm32(ins.offset);
+                a.bytes({0x89, 0xC6});                                  // mov esi, eax
+                a.call(reinterpret_cast<const void*>(&JitCompiler::readInput));
+                a.bytes({0x85, 0xC0});                                  // test eax, eax
+                exits.push_back({a.jcc(CC_NE), i, EXIT_ERROR});
+                break;
+            case OpCode::LOOP_START:
+                a.cmpCellZero(0);
+                jumps.push_back({a.jcc(CC_E), ins.arg + 1});
+                break;
+            case OpCode::LOOP_END:
+                a.cmpCellZero(0);
+                jumps.push_back({a.jcc(CC_E), i + 1});
+                a.bytes({0x45, 0x85, 0xF6});                            // test r14d, r14d
+                jumps.push_back({a.jcc(CC_GE), ins.arg + 1});
+                exits.push_back({a.jmp(), ins.arg + 1, EXIT_BUDGET});
+                break;
+            case OpCode::CLEAR:
+                a.cmpCellZero(0);
+                jumps.push_back({a.jcc(CC_E), ins.arg + 1});
+                if (cells == CellBehavior::WRAP) {
+                    a.cell(0xC6, 0xC7, 0, 0);                           // mov cell, 0
+                    a.cellImm(0);
+                    jumps.push_back({a.jmp(), ins.arg + 1});
+                } else {
+                    a.loopArguments(i);
+                    a.call(reinterpret_cast<const void*>(&JitCompiler::clearLoop));
+                    a.bytes({0x85, 0xC0});
+                    jumps.push_back({a.jcc(CC_NE), ins.arg + 1});
+                }
+                break;
+            case OpCode::MULTIPLY: {
+                int body = i + 1;
+                while (program[body].op == OpCode::MUL_TERM) {
+                    body++;
+                }
+                a.cmpCellZero(0);
+                jumps.push_back({a.jcc(CC_E), ins.arg + 1});
+                if (cells != CellBehavior::WRAP) {
+                    a.loopArguments(i);
+                    a.call(reinterpret_cast<const void*>(&JitCompiler::multiplyLoop));
+                    a.bytes({0x85, 0xC0});
+                    jumps.push_back({a.jcc(CC_NE), ins.arg + 1});
+                    jumps.push_back({a.jmp(), body});
+                    break;
+                }
+
+                a.loadCell(RAX, 0);                                     // eax = iterations
+                if (program[i + 1].arg == 1) {
+                    a.bytes({0xF7, 0xD8});                              // neg eax
+                    if (cellBytes < 4) {
+                        a.bytes({0x05});                                // add eax, 1 << width
+                        a.imm32(1 << (8 * cellBytes));
+                    }
+                }
+                long long low = 0;
+                long long high = 0;
+                for (int t = i + 2; t < body; ++t) {
+                    low = std::min<long long>(low, program[t].offset);
+                    high = std::max<long long>(high, program[t].offset);
+                }
+                // A faulting probe re-runs the whole idiom in the interpreter, which
+                // falls back to the loop body just like the compare does.
+                if (low < 0) {
+                    check(low, i, body);
+                }
+                if (high > 0) {
+                    check(high, i, body);
+                }
+                for (int t = i + 2; t < body; ++t) {
+                    if (program[t].arg == 0) {
+                        continue;
+                    }
+                    a.bytes({0x69, 0xD0});                              // imul edx, eax, delta
+                    a.imm32(program[t].arg);
+                    a.cell(0x00, 0x01, RDX, program[t].offset);         // add cell, edx
+                }
+                a.cell(0xC6, 0xC7, 0, 0);
+                a.cellImm(0);
+                jumps.push_back({a.jmp(), ins.arg + 1});
+                break;
+            }
+            case OpCode::MUL_TERM:
+                break;
+            case OpCode::SCAN: {
+                size_t loop = a.size();
+                a.cmpCellZero(0);
+                jumps.push_back({a.jcc(CC_E), ins.arg + 1});
+                a.checkIndex(RAX, ins.offset, tapeSize);
+                jumps.push_back({a.jcc(CC_AE), i + 1});
+                a.bytes({0x49, 0x89, 0xC4});                            // mov r12, rax
+                a.patch(a.jmp(), loop);
+                break;
+            }
+            case OpCode::BREAK:
+                exits.push_back({a.jmp(), i + 1, EXIT_BREAK});
+                break;
+        }
+        if (isStraightOp(ins.op) && runStart[i + 1] == i + 1) {
+            charge(i + 1 - runStart[i]);
+        }
+    }
+
+    start[size] = a.size();
+    exits.push_back({a.jmp(), size, EXIT_END});
+
+    // Re-entering in the middle of a straight run needs its own range check.
+    entries.assign(size + 1, 0);
+    for (int i = 0; i <= size; ++i) {
+        if (i > 0 && i < size && isStraightOp(program[i].op) && isStraightOp(program[i - 1].op)) {
+            entries[i] = static_cast<uint32_t>(a.size());
+            charge(runStart[i] - i);
+            guard(i);
+            a.patch(a.jmp(), start[i]);
+        } else {
+            entries[i] = static_cast<uint32_t>(start[i]);
+        }
+    }
+
+    std::vector<size_t> toEpilogue;
+    std::map<std::pair<int, int>, size_t> stubs;
+    auto stub = [&](int ip, int reason) {
+        auto found = stubs.find({ip, reason});
+        if (found == stubs.end()) {
+            found = stubs.emplace(std::make_pair(ip, reason), a.size()).first;
+            // A deopt leaves op ip to the host: the run before it has executed, while an
+            // op that isn't straight has already charged itself.
+            if (reason == EXIT_DEOPT) {
+                charge(isStraightOp(program[ip].op) ? ip - runStart[ip] : -1);
+            }
+            a.bytes({0x41, 0xC7, 0x85});                                // mov [r13 + ip], ip
+            a.imm32(offsetof(JitContext, ip));
+            a.imm32(ip);
+            a.bytes({0xB8});                                            // mov eax, reason
+            a.imm32(reason);
+            toEpilogue.push_back(a.jmp());
+        }
+        return found->second;
+    };
+    for (const Exit& exit : exits) {
+        a.patch(exit.at, stub(exit.ip, exit.reason));
+    }
+    probes.clear();
+    for (const auto& fault : faults) {
+        probes.push_back({static_cast<uint32_t>(fault.first), static_cast<uint32_t>(stub(fault.second, EXIT_DEOPT))});
+    }
+
+    size_t epilogue = a.size();
+    a.bytes({0x45, 0x89, 0xA5});                                        // mov [r13 + pointer], r12d
+    a.imm32(offsetof(JitContext, pointer));
+    a.bytes({0x45, 0x89, 0xB5});                                        // mov [r13 + budget], r14d
+    a.imm32(offsetof(JitContext, budget));
+    a.bytes({0x48, 0x83, 0xC4, 0x08});                                  // add rsp, 8
+    a.bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3});
+
+    for (size_t at : toEpilogue) {
+        a.patch(at, epilogue);
+    }
+    for (const auto& jump : jumps) {
+        a.patch(jump.first, start[jump.second]);
+    }
+
+    void* buffer = mmap(nullptr, a.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        return false;
+    }
+    std::memcpy(buffer, a.code.data(), a.size());
+    if (mprotect(buffer, a.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(buffer, a.size());
+        return false;
+    }
+
+    code = static_cast<uint8_t*>(buffer);
+    codeSize = a.size();
+    enter = reinterpret_cast<int (*)(JitContext*)>(code);
+    if (!probes.empty()) {
+        installFaultHandler();
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+#if MB_DLOPEN
+namespace {
+
+// Per user, like any other cache: a shared directory would let anyone plant a module.
+std::filesystem::path defaultCacheDir() {
+    namespace fs = std::filesystem;
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+        return fs::path(cache) / "mindboggler";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return fs::path(home) / ".cache" / "mindboggler";
+    }
+    std::error_code error;
+    return fs::temp_directory_path(error) / ("mindboggler-" + std::to_string(geteuid()));
+}
+
+// Whatever sits in the cache gets loaded into the process, so it has to be ours and
+// writable by no one else: the directory is created 0700, and an existing one or an
+// existing module is only trusted under the same rules.
+bool trusted(const struct stat& info) {
+    return info.st_uid == geteuid() && (info.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool privateDirectory(const std::filesystem::path& dir) {
+    std::error_code error;
+    std::filesystem::create_directories(dir.parent_path(), error);
+    if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+    struct stat info;
+    return stat(dir.c_str(), &info) == 0 && S_ISDIR(info.st_mode) && trusted(info);
+}
+
+// A module is one function, and cc takes time that grows faster than its size: seconds
+// for 4096 ops, about a minute for three times that. Larger programs stay on threaded
+// dispatch.
+const size_t maxModuleOps = 4096;
+
+bool trustedModule(const std::filesystem::path& library) {
+    struct stat info;
+    return lstat(library.c_str(), &info) == 0 && S_ISREG(info.st_mode) && trusted(info);
+}
+
+// cc with its arguments as they are, no shell in between; its chatter goes to /dev/null.
+bool runCompiler(const std::string& sourcePath, const std::string& outputPath) {
+    const char* argv[] = {"cc", "-O2", "-shared", "-fPIC", "-o", outputPath.c_str(), sourcePath.c_str(), nullptr};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    pid_t child;
+    int failed = posix_spawnp(&child, "cc", &actions, nullptr, const_cast<char* const*>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (failed) {
+        return false;
+    }
+
+    int status = 0;
+    while (waitpid(child, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+}
+#endif
+
+// Builds the transpiled program with the system C compiler. Modules are cached by a hash
+// of their source, so a program only pays for cc the first time it runs in a given mode.
+// Both files are written under temporary names and renamed into place, so a reader
+// never sees half of one.
+bool JitCompiler::compileC(const std::string& cacheDir) {
+#if MB_DLOPEN
+    namespace fs = std::filesystem;
+
+    if (interp.compiledProgram.size() > maxModuleOps) {
+        return false;
+    }
+
+    fs::path dir = cacheDir.empty() ? defaultCacheDir() : fs::path(cacheDir);
+    if (!privateDirectory(dir)) {
+        return false;
+    }
+
+    std::string source = CTranspiler::generate(interp.compiledProgram, interp.pointerBehavior,
+                                               interp.cellBehavior, interp.cellWidth, interp.memorySize);
+    fs::path base = dir / ("mb_" + CTranspiler::hash(source));
+    fs::path library = base;
+    library += ".so";
+
+    std::error_code error;
+    if (!fs::exists(library, error)) {
+        const std::string suffix = std::string(".").append(std::to_string(getpid())).append(".tmp");
+        fs::path sourcePath = base;
+        sourcePath += ".c";
+        fs::path partialSource = base;
+        partialSource += suffix + ".c";
+        fs::path partial = base;
+        partial += suffix;
+
+        std::ofstream out(partialSource, std::ios::binary);
+        out << source;
+        out.close();
+        if (!out) {
+            fs::remove(partialSource, error);
+            return false;
+        }
+
+        bool built = runCompiler(partialSource.string(), partial.string());
+        fs::rename(partialSource, sourcePath, error);
+        if (!built) {
+            fs::remove(partial, error);
+            return false;
+        }
+        fs::rename(partial, library, error);
+        if (error) {
+            fs::remove(partial, error);
+            return false;
+        }
+    }
+    if (!trustedModule(library)) {
+        return false;
+    }
+
+    module = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!module) {
+        return false;
+    }
+    enter = reinterpret_cast<int (*)(JitContext*)>(dlsym(module, "mb_run"));
+    entries.clear();
+    probes.clear();
+    return enter != nullptr;
+#else
+    (void)cacheDir;
+    return false;
+#endif
+}
+
+int JitCompiler::run(int& pc, int maxSteps) {
+    const int size = static_cast<int>(interp.compiledProgram.size());
+    int steps = 0;
+
+    JitContext ctx;
+    ctx.memory = interp.memory.data();
+    ctx.outputLength = 0;
+    ctx.owner = this;
+    ctx.flush = &JitCompiler::flushOutput;
+    ctx.input = &JitCompiler::readInput;
+    ctx.clearLoop = &JitCompiler::clearLoop;
+    ctx.multiplyLoop = &JitCompiler::multiplyLoop;
+
+    // A deopt can land anywhere, so keep going until the code gives up on a backward
+    // jump (re-entering with no budget left does that at the first one).
+    int reason = EXIT_BUDGET;
+    while (pc < size && (steps < maxSteps || reason == EXIT_DEOPT)) {
+        // A C module can't be entered in the middle of a straight run, so the rest of
+        // the run goes through the interpreter.
+        if (module) {
+            while (pc > 0 && pc < size && isStraightOp(interp.compiledProgram[pc].op) &&
+                   isStraightOp(interp.compiledProgram[pc - 1].op)) {
+                interp.executeInstruction(pc);
+                steps++;
+            }
+            if (pc >= size) {
+                break;
+            }
+        }
+        int budget = maxSteps - steps;
+        ctx.pointer = interp.pointer;
+        ctx.ip = pc;
+        ctx.budget = budget;
+        ctx.entry = entries.empty() ? nullptr : code + entries[pc];
+
+#if MB_JIT_X86_64
+        JitCompiler* outer = runningJit;
+        runningJit = this;
+        reason = enter(&ctx);
+        runningJit = outer;
+#else
+        reason = enter(&ctx);
+#endif
+
+        flushOutput(&ctx);
+        interp.pointer = ctx.pointer;
+        pc = ctx.ip;
+        steps += budget - ctx.budget;
+
+        if (reason == EXIT_ERROR) {
+            std::exception_ptr error = pendingError;
+            pendingError = nullptr;
+            std::rethrow_exception(error);
+        }
+        if (reason == EXIT_BREAK) {
+            steps++;
+            break;
+        }
+        if (reason == EXIT_DEOPT) {
+            interp.executeInstruction(pc);
+            steps++;
+        }
+    }
+
+    return steps;
+}
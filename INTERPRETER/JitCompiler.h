@@ -0,0 +1,68 @@
+#ifndef JITCOMPILER_H
+#define JITCOMPILER_H
+
+
+#include "Interpreter.h"
+#include <vector>
+#include <string>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+
+// Shared between the host and the generated code, which addresses it by field offset.
+// The transpiled C module declares the same layout (see CTranspiler).
+struct JitContext {
+    void* memory;
+    int pointer;
+    int ip;
+    int budget;
+    int outputLength;
+    const uint8_t* entry;
+    void* owner;
+    void (*flush)(JitContext* ctx);
+    int (*input)(JitContext* ctx, int index);
+    int (*clearLoop)(JitContext* ctx, int pc, int pointer);
+    int (*multiplyLoop)(JitContext* ctx, int pc, int pointer);
+    char output[4096];
+};
+
+class JitCompiler {
+    private:
+        Interpreter& interp;
+        uint8_t* code;
+        size_t codeSize;
+        void* module;
+        int (*enter)(JitContext* ctx);
+        std::vector<uint32_t> entries;
+        std::vector<std::pair<uint32_t, uint32_t>> probes;
+        std::exception_ptr pendingError;
+
+        static void flushOutput(JitContext* ctx);
+        static int readInput(JitContext* ctx, int index);
+        static int clearLoop(JitContext* ctx, int pc, int pointer);
+        static int multiplyLoop(JitContext* ctx, int pc, int pointer);
+
+    public:
+        explicit JitCompiler(Interpreter& interp);
+        ~JitCompiler();
+
+        JitCompiler(const JitCompiler&) = delete;
+        JitCompiler& operator=(const JitCompiler&) = delete;
+
+        static bool isSupported();
+        static bool canLoadModules();
+        static bool isStraightOp(OpCode op);
+        static void straightReach(const std::vector<Instruction>& program,
+                                  std::vector<long long>& low, std::vector<long long>& high);
+
+        // Called from the SIGSEGV/SIGBUS handler: if the fault is one of this thread's
+        // guard-page probes, points the saved context at the probe's deopt exit.
+        static bool recoverFault(const void* address, void* context);
+
+        bool compile();
+        bool compileC(const std::string& cacheDir);
+        int run(int& pc, int maxSteps);
+};
+
+
+#endif //JITCOMPILER_H
@@ -0,0 +1,173 @@
+#include "OutputSink.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+OutputSink::OutputSink(size_t blockSize)
+    : block(std::make_unique<char[]>(blockSize)), next(block.get()), limit(block.get() + blockSize), written(0) {}
+
+void OutputSink::append(const char* data, size_t size) {
+    if (size > static_cast<size_t>(limit - next)) {
+        flush();
+        if (size >= static_cast<size_t>(limit - block.get())) {
+            written += size;
+            write(data, size);
+            return;
+        }
+    }
+    std::memcpy(next, data, size);
+    next += size;
+}
+
+void OutputSink::flush() {
+    if (next != block.get()) {
+        size_t size = static_cast<size_t>(next - block.get());
+        next = block.get();
+        written += size;
+        write(block.get(), size);
+    }
+}
+
+void OutputSink::clear() {
+    next = block.get();
+    written = 0;
+}
+
+void OutputSink::rewind(size_t offset) {
+    next = block.get();
+    written = offset;
+}
+
+bool OutputSink::truncate(size_t offset) {
+    if (offset < written || offset > cursor()) {
+        return false;
+    }
+    next = block.get() + (offset - written);
+    return true;
+}
+
+const std::string& OutputSink::text() const {
+    static const std::string none;
+    return none;
+}
+
+size_t OutputSink::readSince(size_t, std::string&) const {
+    return end();
+}
+
+BufferOutput::BufferOutput(size_t limit) : capacity(limit), discarded(0) {}
+
+void BufferOutput::write(const char* data, size_t size) {
+    contents.append(data, size);
+    if (capacity != std::string::npos && contents.size() > 2 * capacity) {
+        size_t excess = contents.size() - capacity;
+        contents.erase(0, excess);
+        discarded += excess;
+    }
+}
+
+// Bytes already trimmed off the front are skipped.
+size_t BufferOutput::readSince(size_t offset, std::string& out) const {
+    size_t from = std::max(offset, discarded) - discarded;
+    if (from < contents.size()) {
+        out.append(contents, from, std::string::npos);
+    }
+    return end();
+}
+
+void BufferOutput::clear() {
+    OutputSink::clear();
+    contents.clear();
+    discarded = 0;
+}
+
+bool BufferOutput::truncate(size_t offset) {
+    if (offset >= end()) {
+        return OutputSink::truncate(offset);
+    }
+    rewind(offset);
+    if (offset < discarded) {
+        contents.clear();
+        discarded = offset;
+    } else {
+        contents.resize(offset - discarded);
+    }
+    return true;
+}
+
+FileOutput::FileOutput(std::FILE* stream) : stream(stream) {}
+
+FileOutput::~FileOutput() {
+    flush();
+}
+
+// Blocks are already large, and a flush usually means the program is about to wait
+// for input, so push them straight through stdio.
+void FileOutput::write(const char* data, size_t size) {
+    std::fwrite(data, 1, size, stream);
+    std::fflush(stream);
+}
+
+ChannelOutput::ChannelOutput(size_t limit, size_t ringSize)
+    : BufferOutput(limit), ring(std::make_unique<char[]>(ringSize)), ringSize(ringSize),
+      head(0), tail(0), skipped(0), origin(0) {}
+
+void ChannelOutput::write(const char* data, size_t size) {
+    BufferOutput::write(data, size);
+
+    size_t at = head.load(std::memory_order_relaxed);
+    size_t room = ringSize - (at - tail.load(std::memory_order_acquire));
+    if (size > room) {
+        skipped.fetch_add(size - room, std::memory_order_relaxed);
+        size = room;
+    }
+    for (size_t done = 0; done < size;) {
+        size_t index = (at + done) % ringSize;
+        size_t run = std::min(size - done, ringSize - index);
+        std::memcpy(ring.get() + index, data + done, run);
+        done += run;
+    }
+    head.store(at + size, std::memory_order_release);
+}
+
+// Only called while nothing is writing, like the rest of the reset path.
+void ChannelOutput::clear() {
+    BufferOutput::clear();
+    origin = head.load(std::memory_order_relaxed);
+    tail.store(origin, std::memory_order_relaxed);
+    skipped.store(0, std::memory_order_relaxed);
+}
+
+bool ChannelOutput::truncate(size_t offset) {
+    const bool streamed = offset < end();
+    if (!BufferOutput::truncate(offset)) {
+        return false;
+    }
+    if (streamed) {
+        size_t at = head.load(std::memory_order_relaxed);
+        tail.store(at, std::memory_order_relaxed);
+        skipped.store(0, std::memory_order_relaxed);
+        origin = at - offset;
+    }
+    return true;
+}
+
+size_t ChannelOutput::drain(std::string& out) {
+    size_t from = tail.load(std::memory_order_relaxed);
+    size_t to = head.load(std::memory_order_acquire);
+    while (from != to) {
+        size_t index = from % ringSize;
+        size_t run = std::min(to - from, ringSize - index);
+        out.append(ring.get() + index, run);
+        from += run;
+    }
+    tail.store(to, std::memory_order_release);
+    return to - origin + skipped.load(std::memory_order_relaxed);
+}
+
+CallbackOutput::CallbackOutput(std::function<void(const char* data, size_t size)> callback, size_t blockSize)
+    : OutputSink(blockSize), callback(std::move(callback)) {}
+
+void CallbackOutput::write(const char* data, size_t size) {
+    callback(data, size);
+}
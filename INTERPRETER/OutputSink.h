@@ -0,0 +1,141 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Where `.` writes to. Bytes collect in a fixed block, and only a full block or an
+// explicit flush() hands them to write(), so output costs the same per byte however
+// much a program prints.
+class OutputSink {
+    private:
+        std::unique_ptr<char[]> block;
+        char* next;
+        char* limit;
+        size_t written;
+
+    protected:
+        virtual void write(const char* data, size_t size) = 0;
+        // For sinks that keep their output: drops the block and counts on from offset.
+        void rewind(size_t offset);
+
+    public:
+        explicit OutputSink(size_t blockSize = 1 << 16);
+        virtual ~OutputSink() = default;
+
+        OutputSink(const OutputSink&) = delete;
+        OutputSink& operator=(const OutputSink&) = delete;
+
+        void put(char c) {
+            if (next == limit) {
+                flush();
+            }
+            *next++ = c;
+        }
+
+        void append(const char* data, size_t size);
+        void flush();
+
+        // Drops pending output, and anything the sink itself keeps.
+        virtual void clear();
+        // The output kept so far, for sinks that keep any.
+        virtual const std::string& text() const;
+        // Offsets count every byte written since the last clear(), kept or not. end() is
+        // the offset the next byte gets; readSince() appends what is still kept from
+        // `offset` on and returns end(), so a reader can follow the output in steps.
+        virtual size_t end() const { return 0; }
+        virtual size_t readSince(size_t offset, std::string& out) const;
+        // The offset the next put() gets, counting what still waits in the block.
+        size_t cursor() const { return written + static_cast<size_t>(next - block.get()); }
+        // Takes the output back to `offset` (as from cursor()), dropping everything
+        // after it. Returns false when some of that has already gone where the sink
+        // can't take it back from, which here is anything past the block.
+        virtual bool truncate(size_t offset);
+};
+
+// Keeps the output in memory. With a limit, only roughly the last `limit` bytes are
+// kept (never more than twice that), so a program can print forever in bounded memory.
+class BufferOutput : public OutputSink {
+    private:
+        std::string contents;
+        size_t capacity;
+        size_t discarded;
+
+    protected:
+        void write(const char* data, size_t size) override;
+
+    public:
+        explicit BufferOutput(size_t limit = std::string::npos);
+
+        void clear() override;
+        const std::string& text() const override { return contents; }
+        size_t end() const override { return discarded + contents.size(); }
+        size_t readSince(size_t offset, std::string& out) const override;
+        // Bytes already trimmed off the front stay dropped.
+        bool truncate(size_t offset) override;
+        size_t droppedBytes() const { return discarded; }
+};
+
+// Streams to a FILE* such as stdout or a file on disk.
+class FileOutput : public OutputSink {
+    private:
+        std::FILE* stream;
+
+    protected:
+        void write(const char* data, size_t size) override;
+
+    public:
+        explicit FileOutput(std::FILE* stream);
+        ~FileOutput() override;
+};
+
+// A BufferOutput that also streams what is written through a lock-free ring with one
+// writer (the thread running the program) and one reader, so the UI can show output
+// while the run goes on. Bytes the reader hasn't made room for are left out of the
+// stream; text() still has them once the writer is done.
+class ChannelOutput : public BufferOutput {
+    private:
+        std::unique_ptr<char[]> ring;
+        size_t ringSize;
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        std::atomic<size_t> skipped;
+        size_t origin;
+
+    protected:
+        void write(const char* data, size_t size) override;
+
+    public:
+        explicit ChannelOutput(size_t limit = std::string::npos, size_t ringSize = 1 << 20);
+
+        void clear() override;
+        // Like clear(), only while nothing is writing. If streamed bytes go, the stream
+        // drops whatever the reader hasn't drained and carries on from offset, so the
+        // reader should catch up through readSince().
+        bool truncate(size_t offset) override;
+
+        // Reader side: appends the bytes written since the last call and returns the
+        // offset (as in end()) they reach, counting the bytes left out. The offset is
+        // exact once the writer is idle.
+        size_t drain(std::string& out);
+};
+
+class CallbackOutput : public OutputSink {
+    private:
+        std::function<void(const char* data, size_t size)> callback;
+
+    protected:
+        void write(const char* data, size_t size) override;
+
+    public:
+        explicit CallbackOutput(std::function<void(const char* data, size_t size)> callback,
+                                size_t blockSize = 1 << 16);
+};
+
+
+#endif //OUTPUTSINK_H
@@ -0,0 +1,209 @@
+#include "Tape.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MB_MMAP_TAPE 1
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#else
+#define MB_MMAP_TAPE 0
+#endif
+
+namespace {
+
+const size_t guardBytes = 1 << 20;
+
+bool allZero(const unsigned char* data, size_t size) {
+    return data[0] == 0 && std::memcmp(data, data + 1, size - 1) == 0;
+}
+
+}
+
+Tape::Tape() : region(nullptr), regionLength(0), base(nullptr), length(0), below(0), above(0) {}
+
+Tape::~Tape() {
+    release();
+}
+
+void Tape::allocate(size_t bytes) {
+    release();
+    if (bytes == 0) {
+        return;
+    }
+
+#if MB_MMAP_TAPE
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t pages = (bytes + page - 1) / page * page;
+    const size_t total = guardBytes + pages + guardBytes;
+
+    void* reserved = mmap(nullptr, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    unsigned char* start = static_cast<unsigned char*>(reserved);
+    if (mprotect(start + guardBytes, pages, PROT_READ | PROT_WRITE) != 0) {
+        munmap(reserved, total);
+        throw std::bad_alloc();
+    }
+
+    region = start;
+    regionLength = total;
+    base = start + guardBytes + (pages - bytes);
+    length = bytes;
+    below = pages == bytes ? guardBytes : 0;
+    above = guardBytes;
+#else
+    void* storage = std::calloc(bytes, 1);
+    if (!storage) {
+        throw std::bad_alloc();
+    }
+    region = static_cast<unsigned char*>(storage);
+    regionLength = bytes;
+    base = region;
+    length = bytes;
+#endif
+}
+
+void Tape::clear() {
+    if (!base) {
+        return;
+    }
+
+#if MB_MMAP_TAPE
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    unsigned char* pages = region + (base - region) / page * page;
+    const size_t span = static_cast<size_t>(base + length - pages);
+#endif
+#if MB_MMAP_TAPE && defined(__linux__)
+    // Private anonymous pages read back as zero once dropped, and only the pages
+    // the program actually touched have anything to drop.
+    if (madvise(pages, span, MADV_DONTNEED) == 0) {
+        return;
+    }
+#elif MB_MMAP_TAPE
+    void* remapped = mmap(pages, span, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    if (remapped != MAP_FAILED) {
+        return;
+    }
+#endif
+    std::memset(base, 0, length);
+}
+
+bool Tape::isGuard(const void* address) const {
+    const uintptr_t at = reinterpret_cast<uintptr_t>(address);
+    const uintptr_t start = reinterpret_cast<uintptr_t>(base);
+    return (at < start && start - at <= below) || (at >= start + length && at - (start + length) < above);
+}
+
+void Tape::release() {
+    if (!region) {
+        return;
+    }
+#if MB_MMAP_TAPE
+    munmap(region, regionLength);
+#else
+    std::free(region);
+#endif
+    region = nullptr;
+    regionLength = 0;
+    base = nullptr;
+    length = 0;
+    below = 0;
+    above = 0;
+}
+
+TapeImage Tape::capture(const TapeImage& previous, size_t first, size_t last) const {
+    const size_t page = TapeImage::PAGE;
+    const size_t span = TapeImage::PAGE * TapeImage::GROUP;
+    const bool related = previous.length == length;
+    if (!related) {
+        first = 0;
+        last = length;
+    }
+
+    TapeImage image;
+    image.length = length;
+    image.groups.resize((length + span - 1) / span);
+    for (size_t g = 0; g < image.groups.size(); ++g) {
+        const size_t groupStart = g * span;
+        const size_t groupEnd = std::min(length, groupStart + span);
+        std::shared_ptr<const TapeImage::Group> old = related ? previous.groups[g] : nullptr;
+        if (groupEnd <= first || groupStart >= last) {
+            image.groups[g] = old;
+            continue;
+        }
+
+        TapeImage::Group pages;
+        bool changed = false;
+        bool stored = false;
+        for (size_t p = 0; p < TapeImage::GROUP && groupStart + p * page < groupEnd; ++p) {
+            const size_t start = groupStart + p * page;
+            const size_t size = std::min(groupEnd, start + page) - start;
+            std::shared_ptr<const TapeImage::Page> before = old ? (*old)[p] : nullptr;
+            const unsigned char* bytes = base + start;
+
+            if (start + size <= first || start >= last ||
+                (before ? std::memcmp(before->data(), bytes, size) == 0 : allZero(bytes, size))) {
+                pages[p] = before;
+            } else if (allZero(bytes, size)) {
+                pages[p] = nullptr;
+            } else {
+                auto copy = std::make_shared<TapeImage::Page>();
+                std::memcpy(copy->data(), bytes, size);
+                pages[p] = std::move(copy);
+            }
+            changed = changed || pages[p] != before;
+            stored = stored || pages[p] != nullptr;
+        }
+        if (!changed) {
+            image.groups[g] = old;
+        } else if (stored) {
+            image.groups[g] = std::make_shared<const TapeImage::Group>(std::move(pages));
+        }
+    }
+    return image;
+}
+
+void Tape::restore(const TapeImage& image, const TapeImage& current, size_t first, size_t last) {
+    const size_t page = TapeImage::PAGE;
+    const size_t span = TapeImage::PAGE * TapeImage::GROUP;
+    const bool related = current.length == length;
+    if (!related) {
+        first = 0;
+        last = length;
+    }
+
+    for (size_t g = 0; g < image.groups.size() && g * span < length; ++g) {
+        const size_t groupStart = g * span;
+        const size_t groupEnd = std::min(length, groupStart + span);
+        const TapeImage::Group* want = image.groups[g].get();
+        const TapeImage::Group* have = related ? current.groups[g].get() : nullptr;
+        const bool written = groupStart < last && groupEnd > first;
+        if (related && !written && want == have) {
+            continue;
+        }
+
+        for (size_t p = 0; p < TapeImage::GROUP && groupStart + p * page < groupEnd; ++p) {
+            const size_t start = groupStart + p * page;
+            const size_t size = std::min(groupEnd, start + page) - start;
+            const TapeImage::Page* wantPage = want ? (*want)[p].get() : nullptr;
+            const TapeImage::Page* havePage = have ? (*have)[p].get() : nullptr;
+            if (related && (start >= last || start + size <= first) && wantPage == havePage) {
+                continue;
+            }
+            if (wantPage) {
+                std::memcpy(base + start, wantPage->data(), size);
+            } else {
+                std::memset(base + start, 0, size);
+            }
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef TAPE_H
+#define TAPE_H
+
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// The bytes of a tape as Tape::capture() found them. Captures share every page that
+// did not change in between, and all-zero pages are not stored, so keeping many of
+// them costs only what the program wrote between them. Pages are grouped so that the
+// page table itself is shared where a whole group is unchanged.
+class TapeImage {
+    friend class Tape;
+
+    private:
+        static constexpr size_t PAGE = 4096;
+        static constexpr size_t GROUP = 64;
+
+        using Page = std::array<unsigned char, PAGE>;
+        using Group = std::array<std::shared_ptr<const Page>, GROUP>;
+
+        std::vector<std::shared_ptr<const Group>> groups;
+        size_t length = 0;
+
+    public:
+        size_t size() const { return length; }
+};
+
+// Zero-filled cell storage. Where anonymous mmap is available the region is only
+// reserved up front and the OS backs each page on first touch, so a large tape costs
+// nothing until the program walks into it, and clearing it releases the pages again.
+//
+// Mapped tapes are also fenced by inaccessible guard pages. The data ends exactly on a
+// page boundary, so any access past the last cell faults; the first cell is only fenced
+// as well when the data happens to fill whole pages.
+class Tape {
+    private:
+        unsigned char* region;
+        size_t regionLength;
+        unsigned char* base;
+        size_t length;
+        size_t below;
+        size_t above;
+
+        void release();
+
+    public:
+        Tape();
+        ~Tape();
+
+        Tape(const Tape&) = delete;
+        Tape& operator=(const Tape&) = delete;
+
+        void allocate(size_t bytes);
+        void clear();
+
+        unsigned char* data() const { return base; }
+        size_t size() const { return length; }
+
+        // Bytes right before and after the data that are guaranteed to fault.
+        size_t guardBelow() const { return below; }
+        size_t guardAbove() const { return above; }
+        bool isGuard(const void* address) const;
+
+        // A capture that takes every page outside bytes [first, last) from `previous`,
+        // an earlier capture of this tape (anything else captures it all). Pages in the
+        // range are compared and only copied if they changed.
+        TapeImage capture(const TapeImage& previous, size_t first, size_t last) const;
+        // Writes `image` back. `current` must be a capture that matches the tape outside
+        // bytes [first, last), so only pages that differ from it or lie in the range
+        // are written.
+        void restore(const TapeImage& image, const TapeImage& current, size_t first, size_t last);
+};
+
+
+#endif //TAPE_H
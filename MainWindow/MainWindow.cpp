@@ -1,4 +1,5 @@
 #include "MainWindow.h"
+#include "../INTERPRETER/JitCompiler.h"
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QWidget>
 #include <QtWidgets/QInputDialog>
@@ -11,6 +12,7 @@
 #include <QtCore/QStandardPaths>
 #include <QtGui/QTextDocument>
 #include <sstream>
+#include <limits>
 
 CodeEditor::CodeEditor(QWidget* parent)
     : QPlainTextEdit(parent), currentColor(255, 255, 0, 90), breakpointColor(255, 0, 0, 90) {
@@ -70,7 +72,7 @@ void CodeEditor::updateHighlighting(int currentPc) {
 SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent) {
     setWindowTitle("Settings");
     setModal(true);
-    resize(450, 400);
+    resize(450, 730);
 
     auto* layout = new QVBoxLayout(this);
 
@@ -83,21 +85,25 @@ SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent) {
     clampRadio = new QRadioButton("Clamp (safe - stays at boundaries)");
     wrapRadio = new QRadioButton("Wrap-around (circular memory)");
     errorRadio = new QRadioButton("Error on overflow/underflow");
+    unboundedRadio = new QRadioButton("Unbounded (tape grows to the right on demand)");
 
     pointerBehaviorGroup->addButton(clampRadio, static_cast<int>(PointerBehavior::CLAMP));
     pointerBehaviorGroup->addButton(wrapRadio, static_cast<int>(PointerBehavior::WRAP));
     pointerBehaviorGroup->addButton(errorRadio, static_cast<int>(PointerBehavior::ERROR));
+    pointerBehaviorGroup->addButton(unboundedRadio, static_cast<int>(PointerBehavior::UNBOUNDED));
 
     clampRadio->setChecked(true);
 
     pointerLayout->addWidget(clampRadio);
     pointerLayout->addWidget(wrapRadio);
     pointerLayout->addWidget(errorRadio);
+    pointerLayout->addWidget(unboundedRadio);
 
     auto* descLabel = new QLabel(
         "• Clamp: Pointer stops at memory boundaries (0 and memory_size-1)\n"
         "• Wrap-around: Pointer wraps to opposite end when crossing boundaries\n"
-        "• Error: Throw exception when pointer goes out of bounds"
+        "• Error: Throw exception when pointer goes out of bounds\n"
+        "• Unbounded: Memory is allocated as the pointer reaches it; error below 0"
     );
     descLabel->setStyleSheet("color: gray; font-size: 9pt;");
     pointerLayout->addWidget(descLabel);
@@ -110,8 +116,8 @@ SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent) {
 
     cellBehaviorGroup = new QButtonGroup(this);
 
-    cellWrapRadio = new QRadioButton("Wrap (0-255, standard Brainfuck)");
-    cellUnlimitedRadio = new QRadioButton("Unlimited (allow values beyond 0-255)");
+    cellWrapRadio = new QRadioButton("Wrap (standard Brainfuck)");
+    cellUnlimitedRadio = new QRadioButton("Unlimited (allow values beyond the cell range)");
     cellErrorRadio = new QRadioButton("Error on underflow/overflow");
 
     cellBehaviorGroup->addButton(cellWrapRadio, static_cast<int>(CellBehavior::WRAP));
@@ -125,9 +131,9 @@ SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent) {
     cellLayout->addWidget(cellErrorRadio);
 
     auto* cellDesc = new QLabel(
-        "• Wrap: Cell values wrap around 0-255 (255+1=0, 0-1=255)\n"
+        "• Wrap: Cell values wrap around the cell width (255+1=0, 0-1=255 for 8-bit)\n"
         "• Unlimited: Cell values can exceed 0-255 range (useful for calculations)\n"
-        "• Error: Throw exception when cell goes below 0 or above 255"
+        "• Error: Throw exception when cell goes below 0 or above the width's maximum"
     );
     cellDesc->setStyleSheet("color: gray; font-size: 9pt;");
     cellLayout->addWidget(cellDesc);
@@ -135,6 +141,70 @@ SettingsDialog::SettingsDialog(QWidget* parent) : QDialog(parent) {
     layout->addWidget(cellGroup);
 
    
+    auto* widthGroup = new QGroupBox("Cell Width");
+    auto* widthLayout = new QVBoxLayout(widthGroup);
+
+    cellWidthGroup = new QButtonGroup(this);
+
+    width8Radio = new QRadioButton("8-bit (0-255)");
+    width16Radio = new QRadioButton("16-bit (0-65535)");
+    width32Radio = new QRadioButton("32-bit (0-4294967295)");
+
+    cellWidthGroup->addButton(width8Radio, static_cast<int>(CellWidth::BITS_8));
+    cellWidthGroup->addButton(width16Radio, static_cast<int>(CellWidth::BITS_16));
+    cellWidthGroup->addButton(width32Radio, static_cast<int>(CellWidth::BITS_32));
+
+    width8Radio->setChecked(true);
+
+    widthLayout->addWidget(width8Radio);
+    widthLayout->addWidget(width16Radio);
+    widthLayout->addWidget(width32Radio);
+
+    auto* widthDesc = new QLabel(
+        "Range used by Wrap and Error cells. Unlimited cells are always 32-bit signed."
+    );
+    widthDesc->setStyleSheet("color: gray; font-size: 9pt;");
+    widthLayout->addWidget(widthDesc);
+
+    layout->addWidget(widthGroup);
+
+   
+    auto* engineGroup = new QGroupBox("Fast Mode Engine");
+    auto* engineLayout = new QVBoxLayout(engineGroup);
+
+    dispatchModeGroup = new QButtonGroup(this);
+
+    switchRadio = new QRadioButton("Switch dispatch");
+    threadedRadio = new QRadioButton("Threaded dispatch (computed goto)");
+    jitRadio = new QRadioButton("Native JIT (x86-64)");
+    cModuleRadio = new QRadioButton("Transpiled C module (cc + dlopen)");
+
+    dispatchModeGroup->addButton(switchRadio, static_cast<int>(DispatchMode::SWITCH));
+    dispatchModeGroup->addButton(threadedRadio, static_cast<int>(DispatchMode::THREADED));
+    dispatchModeGroup->addButton(jitRadio, static_cast<int>(DispatchMode::JIT));
+    dispatchModeGroup->addButton(cModuleRadio, static_cast<int>(DispatchMode::C_MODULE));
+
+    threadedRadio->setChecked(true);
+    jitRadio->setEnabled(JitCompiler::isSupported());
+    cModuleRadio->setEnabled(JitCompiler::canLoadModules());
+
+    engineLayout->addWidget(switchRadio);
+    engineLayout->addWidget(threadedRadio);
+    engineLayout->addWidget(jitRadio);
+    engineLayout->addWidget(cModuleRadio);
+
+    auto* engineDesc = new QLabel(
+        "• Switch: One shared dispatch branch for every instruction\n"
+        "• Threaded: Each instruction jumps directly to the next handler\n"
+        "• JIT: Compiles the program to machine code before running it\n"
+        "• C module: Builds the program with the system C compiler (cached)"
+    );
+    engineDesc->setStyleSheet("color: gray; font-size: 9pt;");
+    engineLayout->addWidget(engineDesc);
+
+    layout->addWidget(engineGroup);
+
+   
     auto* buttonLayout = new QHBoxLayout();
     okButton = new QPushButton("OK");
     cancelButton = new QPushButton("Cancel");
@@ -158,6 +228,7 @@ void SettingsDialog::setPointerBehavior(PointerBehavior behavior) {
         case PointerBehavior::CLAMP: clampRadio->setChecked(true); break;
         case PointerBehavior::WRAP: wrapRadio->setChecked(true); break;
         case PointerBehavior::ERROR: errorRadio->setChecked(true); break;
+        case PointerBehavior::UNBOUNDED: unboundedRadio->setChecked(true); break;
     }
 }
 
@@ -173,7 +244,33 @@ void SettingsDialog::setCellBehavior(CellBehavior behavior) {
     }
 }
 
-CompileOutputDialog::CompileOutputDialog(QWidget* parent, const QString& title, const QString& content)
+CellWidth SettingsDialog::getCellWidth() const {
+    return static_cast<CellWidth>(cellWidthGroup->checkedId());
+}
+
+void SettingsDialog::setCellWidth(CellWidth width) {
+    switch (width) {
+        case CellWidth::BITS_8: width8Radio->setChecked(true); break;
+        case CellWidth::BITS_16: width16Radio->setChecked(true); break;
+        case CellWidth::BITS_32: width32Radio->setChecked(true); break;
+    }
+}
+
+DispatchMode SettingsDialog::getDispatchMode() const {
+    return static_cast<DispatchMode>(dispatchModeGroup->checkedId());
+}
+
+void SettingsDialog::setDispatchMode(DispatchMode mode) {
+    switch (mode) {
+        case DispatchMode::SWITCH: switchRadio->setChecked(true); break;
+        case DispatchMode::THREADED: threadedRadio->setChecked(true); break;
+        case DispatchMode::JIT: jitRadio->setChecked(true); break;
+        case DispatchMode::C_MODULE: cModuleRadio->setChecked(true); break;
+    }
+}
+
+CompileOutputDialog::CompileOutputDialog(QWidget* parent, const QString& title, const QString& content,
+                                         const QString& exportSource)
     : QDialog(parent) {
     setWindowTitle(title);
     resize(800, 600);
@@ -186,6 +283,22 @@ CompileOutputDialog::CompileOutputDialog(QWidget* parent, const QString& title,
 
     layout->addWidget(textArea);
 
+    if (!exportSource.isEmpty()) {
+        auto* exportBtn = new QPushButton("Export C Source...");
+        connect(exportBtn, &QPushButton::clicked, this, [this, exportSource]() {
+            QString path = QFileDialog::getSaveFileName(this, "Export C source", "program.c",
+                                                       "C source (*.c);;All Files (*)");
+            if (!path.isEmpty()) {
+                QFile file(path);
+                if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                    QTextStream out(&file);
+                    out << exportSource;
+                }
+            }
+        });
+        layout->addWidget(exportBtn);
+    }
+
     auto* closeBtn = new QPushButton("Close");
     connect(closeBtn, &QPushButton::clicked, this, &QDialog::accept);
     layout->addWidget(closeBtn);
@@ -342,9 +455,123 @@ AboutDialog::AboutDialog(QWidget* parent) : QDialog(parent) {
     layout->addLayout(buttonLayout);
 }
 
+MemoryModel::MemoryModel(Interpreter& interp, QObject* parent)
+    : QAbstractTableModel(parent), interp(interp), live(nullptr), rows(0), pointer(0) {}
+
+int MemoryModel::tapeSize() const {
+    return live ? live->memorySize : interp.getMemorySize();
+}
+
+int MemoryModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : rows;
+}
+
+int MemoryModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : COLUMNS;
+}
+
+QVariant MemoryModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::BackgroundRole && role != Qt::ForegroundRole)) {
+        return QVariant();
+    }
+
+    int addr = index.row() * COLUMNS + index.column();
+    if (addr >= tapeSize()) {
+        if (role == Qt::DisplayRole) {
+            return QString("--");
+        }
+        return role == Qt::BackgroundRole ? QColor(240, 240, 240) : QColor(128, 128, 128);
+    }
+
+    long long cellValue;
+    if (!live) {
+        cellValue = interp.getCell(addr);
+    } else if (addr == live->pointer) {
+        cellValue = live->cell;
+    } else if (addr >= live->windowStart && addr < live->windowStart + static_cast<int>(live->window.size())) {
+        cellValue = live->window[addr - live->windowStart];
+    } else {
+        // Scrolled past what the worker copied; the next snapshot fills it in.
+        return QVariant();
+    }
+
+    if (role == Qt::DisplayRole) {
+        return QString::number(cellValue);
+    }
+
+    if (interp.getCellBehavior() == CellBehavior::UNLIMITED && (cellValue < 0 || cellValue > 255)) {
+        if (role == Qt::BackgroundRole) {
+            return addr == pointer ? QColor(255, 100, 100) : QColor(255, 240, 240);
+        }
+        return QColor(150, 0, 0);
+    }
+    if (addr == pointer) {
+        return role == Qt::BackgroundRole ? QColor(0, 100, 0) : QColor(255, 255, 255);
+    }
+    return role == Qt::BackgroundRole ? QColor(255, 255, 255) : QColor(0, 0, 0);
+}
+
+QVariant MemoryModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    if (orientation == Qt::Horizontal) {
+        return QString("%1").arg(section, 0, 16).toUpper();
+    }
+    return QString("%1").arg(section * COLUMNS, 4, 16, QChar('0')).toUpper();
+}
+
+void MemoryModel::refresh(const ExecutionSnapshot* snapshot) {
+    live = snapshot;
+    int oldPointer = pointer;
+    pointer = live ? live->pointer : interp.getPointer();
+
+    int newRows = std::min(MAX_ROWS, (tapeSize() + COLUMNS - 1) / COLUMNS);
+    if (newRows != rows) {
+        beginResetModel();
+        rows = newRows;
+        if (!live) {
+            interp.takeDirtyCells();
+        }
+        endResetModel();
+        return;
+    }
+
+    // The worker's interpreter is off limits, so while it runs the watched cells are
+    // all treated as changed.
+    if (live) {
+        cellsChanged(live->windowStart, live->windowStart + static_cast<int>(live->window.size()) - 1);
+    } else {
+        CellRange dirty = interp.takeDirtyCells();
+        cellsChanged(dirty.first, dirty.last);
+    }
+    if (oldPointer != pointer) {
+        cellsChanged(oldPointer, oldPointer);
+    }
+    cellsChanged(pointer, pointer);
+}
+
+void MemoryModel::cellsChanged(int first, int last) {
+    first = std::max(first, 0);
+    last = std::min(last, rows * COLUMNS - 1);
+    if (first > last) {
+        return;
+    }
+    if (first / COLUMNS == last / COLUMNS) {
+        emit dataChanged(index(first / COLUMNS, first % COLUMNS), index(last / COLUMNS, last % COLUMNS));
+    } else {
+        emit dataChanged(index(first / COLUMNS, 0), index(last / COLUMNS, COLUMNS - 1));
+    }
+}
+
 MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent),
       interp(std::make_unique<Interpreter>()),
+      analysis(std::make_unique<Interpreter>()),
+      runner(std::make_unique<ExecutionThread>(*interp)),
+      outputShown(0),
+      live(nullptr),
+      opsPerSecond(0),
       executionMode(2),
       pausedAtBreakpoint(false) {
 
@@ -355,10 +582,20 @@ MainWindow::MainWindow(QWidget* parent)
     timer = new QTimer(this);
     connect(timer, &QTimer::timeout, this, &MainWindow::onTimer);
 
-    timerIntervals = {{0, 100}, {1, 500}, {2, 1}};
+    // In Fast mode the interval is the UI refresh rate, about 60 Hz; the worker runs
+    // regardless, in slices of WORKER_SLICE.
+    timerIntervals = {{0, 100}, {1, 500}, {2, 16}};
 
-    interp->configure(settings.pointerBehavior, settings.cellBehavior);
+    interp->configure(settings.pointerBehavior, settings.cellBehavior, settings.cellWidth);
+    interp->setDispatchMode(settings.dispatchMode);
+    interp->setNativeCacheDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString());
     interp->setInputCallback([this]() { return requestInput(); });
+    // Debug and Slow steps can be taken back; a Fast run starts the history over.
+    interp->setStepHistory(true);
+    // The output pane only ever shows the tail of a long run.
+    auto sink = std::make_unique<ChannelOutput>(1 << 20);
+    outputChannel = sink.get();
+    interp->setOutputSink(std::move(sink));
 
     buildUI();
     connectActions();
@@ -370,26 +607,23 @@ void MainWindow::buildUI() {
     output = new QPlainTextEdit();
     output->setReadOnly(true);
     output->setPlaceholderText("Program output will appear here…");
+    output->setMaximumBlockCount(10000);
 
-    memTable = new QTableWidget(32, 16);
-    QStringList headers;
-    for (int i = 0; i < 16; ++i) {
-        headers << QString("%1").arg(i, 0, 16).toUpper();
-    }
-    memTable->setHorizontalHeaderLabels(headers);
-
-    QStringList rowHeaders;
-    for (int i = 0; i < 32; ++i) {
-        rowHeaders << QString("%1").arg(i * 16, 4, 16, QChar('0')).toUpper();
-    }
-    memTable->setVerticalHeaderLabels(rowHeaders);
-
-    memTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
-    memTable->setSelectionMode(QAbstractItemView::NoSelection);
+    memModel = new MemoryModel(*interp, this);
+    memView = new QTableView();
+    memView->setModel(memModel);
+    memView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    memView->setSelectionMode(QAbstractItemView::NoSelection);
+    memView->horizontalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    memView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    sizeMemoryColumns();
 
    
     btnRun = new QPushButton("Run");
     btnStep = new QPushButton("Step");
+    btnStepBack = new QPushButton("Step Back");
+    btnRunBack = new QPushButton("Run Back");
+    btnRunBack->setToolTip("Step back to the previous breakpoint, or to where the history starts");
     btnPause = new QPushButton("Pause");
     btnResume = new QPushButton("Resume");
     btnReset = new QPushButton("Reset");
@@ -421,6 +655,8 @@ void MainWindow::buildUI() {
 
     auto* controls = new QHBoxLayout();
     controls->addWidget(btnRun);
+    controls->addWidget(btnStepBack);
+    controls->addWidget(btnRunBack);
     controls->addWidget(btnStep);
     controls->addWidget(btnPause);
     controls->addWidget(btnResume);
@@ -439,8 +675,8 @@ void MainWindow::buildUI() {
     auto* rightLayout = new QVBoxLayout(right);
     rightLayout->addWidget(new QLabel("Output"));
     rightLayout->addWidget(output);
-    rightLayout->addWidget(new QLabel("Memory (hex grid around pointer)"));
-    rightLayout->addWidget(memTable);
+    rightLayout->addWidget(new QLabel("Memory (hex grid)"));
+    rightLayout->addWidget(memView);
 
     auto* splitter = new QSplitter();
     splitter->addWidget(left);
@@ -480,6 +716,8 @@ void MainWindow::buildUI() {
 void MainWindow::connectActions() {
     connect(btnRun, &QPushButton::clicked, this, &MainWindow::onRun);
     connect(btnStep, &QPushButton::clicked, this, &MainWindow::onStep);
+    connect(btnStepBack, &QPushButton::clicked, this, &MainWindow::onStepBack);
+    connect(btnRunBack, &QPushButton::clicked, this, &MainWindow::onRunBack);
     connect(btnPause, &QPushButton::clicked, this, &MainWindow::onPause);
     connect(btnResume, &QPushButton::clicked, this, &MainWindow::onResume);
     connect(btnReset, &QPushButton::clicked, this, &MainWindow::onReset);
@@ -496,6 +734,11 @@ void MainWindow::connectActions() {
 }
 
 std::string MainWindow::requestInput() {
+    // Called as the input callback from the worker too, which has to ask the UI thread.
+    if (runner->isWorker()) {
+        return runner->waitForInput();
+    }
+
     bool ok;
     QString input = QInputDialog::getText(this, "Input Required",
                                          "Enter input for ',' command:",
@@ -516,7 +759,15 @@ void MainWindow::onModeChanged() {
     status->showMessage(modeNames[executionMode] + " mode enabled", 2000);
 
     if (timer->isActive()) {
+        stopWorker();
         timer->setInterval(timerIntervals[executionMode]);
+        if (interp->isRunning() && !pausedAtBreakpoint) {
+            if (executionMode == 2) {
+                startWorker();
+            }
+            timer->start();
+        }
+        updateButtonStates();
     }
 }
 
@@ -526,6 +777,8 @@ void MainWindow::updateButtonStates() {
 
     btnRun->setEnabled(!running && !paused);
     btnStep->setEnabled(!running);
+    btnStepBack->setEnabled(!running && interp->canStepBack());
+    btnRunBack->setEnabled(!running && interp->canStepBack());
     btnPause->setEnabled(running && !paused);
     btnResume->setVisible(paused);
     btnReset->setEnabled(true);
@@ -537,12 +790,16 @@ void MainWindow::onRun() {
     }
 
     pausedAtBreakpoint = false;
+    if (executionMode == 2) {
+        startWorker();
+    }
     timer->setInterval(timerIntervals[executionMode]);
     timer->start();
     updateButtonStates();
 }
 
 void MainWindow::onStep() {
+    stopWorker();
     if (!interp->isRunning() && interp->getPc() == 0) {
         loadInterpreterFromUI();
     }
@@ -554,7 +811,43 @@ void MainWindow::onStep() {
     updateButtonStates();
 }
 
+void MainWindow::onStepBack() {
+    stopWorker();
+    timer->stop();
+    pausedAtBreakpoint = false;
+
+    try {
+        interp->stepBack();
+    } catch (const std::exception& e) {
+        QMessageBox::critical(this, "Runtime Error", QString("Execution error: %1").arg(e.what()));
+    }
+    updateUIAfterStep();
+    updateButtonStates();
+}
+
+// Goes back through the history in one call; the undo log makes even millions of steps
+// quick, so there is no timer to drive it.
+void MainWindow::onRunBack() {
+    stopWorker();
+    timer->stop();
+    pausedAtBreakpoint = false;
+
+    long long steps = 0;
+    try {
+        steps = interp->runBackward(editor->getBreakpoints());
+    } catch (const std::exception& e) {
+        QMessageBox::critical(this, "Runtime Error", QString("Execution error: %1").arg(e.what()));
+    }
+    updateUIAfterStep();
+    updateButtonStates();
+
+    if (editor->getBreakpoints().count(interp->getPc()) && steps > 0) {
+        status->showMessage(QString("Went back %1 steps to a breakpoint").arg(steps), 3000);
+    }
+}
+
 void MainWindow::onPause() {
+    stopWorker();
     timer->stop();
     pausedAtBreakpoint = false;
     updateButtonStates();
@@ -562,17 +855,23 @@ void MainWindow::onPause() {
 
 void MainWindow::onResume() {
     pausedAtBreakpoint = false;
+    if (executionMode == 2) {
+        startWorker();
+    }
     timer->setInterval(timerIntervals[executionMode]);
     timer->start();
     updateButtonStates();
 }
 
 void MainWindow::onReset() {
+    stopWorker();
     timer->stop();
     pausedAtBreakpoint = false;
     interp->reset();
-    interp->configure(settings.pointerBehavior, settings.cellBehavior);
+    interp->configure(settings.pointerBehavior, settings.cellBehavior, settings.cellWidth);
     output->setPlainText("");
+    outputShown = 0;
+    opsPerSecond = 0;
     updateStatus();
     refreshMemory();
     editor->updateHighlighting(-1);
@@ -605,9 +904,8 @@ void MainWindow::onSave() {
 
 void MainWindow::onCheck() {
     std::string program = editor->toPlainText().toStdString();
-    Interpreter tempInterp;
-    tempInterp.loadProgram(program, "");
-    auto errors = tempInterp.checkProgramSyntax();
+    analysis->loadProgram(program, "");
+    auto errors = analysis->checkProgramSyntax();
 
     if (errors.empty()) {
         QMessageBox::information(this, "Syntax", "No syntax errors detected.");
@@ -626,26 +924,37 @@ void MainWindow::onSettings() {
     SettingsDialog dialog(this);
     dialog.setPointerBehavior(settings.pointerBehavior);
     dialog.setCellBehavior(settings.cellBehavior);
+    dialog.setCellWidth(settings.cellWidth);
+    dialog.setDispatchMode(settings.dispatchMode);
 
     if (dialog.exec() == QDialog::Accepted) {
         settings.pointerBehavior = dialog.getPointerBehavior();
         settings.cellBehavior = dialog.getCellBehavior();
+        settings.cellWidth = dialog.getCellWidth();
+        settings.dispatchMode = dialog.getDispatchMode();
 
-        interp->configure(settings.pointerBehavior, settings.cellBehavior);
+        stopWorker();
+        interp->configure(settings.pointerBehavior, settings.cellBehavior, settings.cellWidth);
+        interp->setDispatchMode(settings.dispatchMode);
+        sizeMemoryColumns();
 
         QMap<PointerBehavior, QString> pointerNames = {
             {PointerBehavior::CLAMP, "Clamp"},
             {PointerBehavior::WRAP, "Wrap-around"},
-            {PointerBehavior::ERROR, "Error on overflow"}
+            {PointerBehavior::ERROR, "Error on overflow"},
+            {PointerBehavior::UNBOUNDED, "Unbounded"}
         };
         QMap<CellBehavior, QString> cellNames = {
-            {CellBehavior::WRAP, "Wrap (0-255)"},
+            {CellBehavior::WRAP, "Wrap"},
             {CellBehavior::UNLIMITED, "Unlimited"},
             {CellBehavior::ERROR, "Error on overflow"}
         };
 
         QString pointerName = pointerNames[settings.pointerBehavior];
         QString cellName = cellNames[settings.cellBehavior];
+        if (settings.cellBehavior != CellBehavior::UNLIMITED) {
+            cellName += QString(" (%1-bit)").arg(8 << static_cast<int>(settings.cellWidth));
+        }
 
         status->showMessage(QString("Settings updated: Pointer=%1, Cells=%2")
                           .arg(pointerName).arg(cellName), 3000);
@@ -654,11 +963,12 @@ void MainWindow::onSettings() {
 
 void MainWindow::onCompile() {
     std::string program = editor->toPlainText().toStdString();
-    Interpreter tempInterp;
-    tempInterp.loadProgram(program, "");
+    analysis->configure(settings.pointerBehavior, settings.cellBehavior, settings.cellWidth);
+    analysis->loadProgram(program, "");
 
     try {
-        auto compiled = tempInterp.compileProgram();
+        auto compiled = analysis->compileProgram();
+        const std::vector<SourceRange>& sourceMap = analysis->getSourceMap();
 
         int originalOps = 0;
         for (char c : program) {
@@ -671,9 +981,12 @@ void MainWindow::onCompile() {
 
        
         int optimizations = 0;
-        for (const auto& [cmd, arg] : compiled) {
-            if ((cmd == '+' || cmd == '-' || cmd == '<' || cmd == '>') && arg > 1) {
-                optimizations += arg - 1;
+        int idioms = 0;
+        for (const auto& ins : compiled) {
+            if ((ins.op == OpCode::ADD || ins.op == OpCode::MOVE) && std::abs(ins.arg) > 1) {
+                optimizations += std::abs(ins.arg) - 1;
+            } else if (ins.op == OpCode::CLEAR || ins.op == OpCode::MULTIPLY || ins.op == OpCode::SCAN) {
+                idioms++;
             }
         }
 
@@ -683,20 +996,57 @@ void MainWindow::onCompile() {
         info += QString("Original operations: %1\n").arg(originalOps);
         info += QString("Compiled operations: %1\n").arg(compiledOps);
         info += QString("Operations saved by optimization: %1\n").arg(optimizations);
+        info += QString("Loops collapsed into idioms: %1\n").arg(idioms);
         info += QString("Efficiency improvement: %1%\n\n").arg(efficiency, 0, 'f', 1);
-        info += "Compiled instructions:\n";
+        info += "Compiled instructions (source range, index, op):\n";
         info += QString("-").repeated(40) + "\n";
 
         for (size_t i = 0; i < compiled.size(); ++i) {
-            const auto& [cmd, arg] = compiled[i];
-            if (cmd == '.' || cmd == ',') {
-                info += QString("%1: %2\n").arg(i, 3).arg(cmd);
-            } else {
-                info += QString("%1: %2 %3\n").arg(i, 3).arg(cmd).arg(arg);
+            const Instruction& ins = compiled[i];
+            QString at = ins.offset ? QString("p[%1]").arg(ins.offset) : QString("p");
+            info += QString("%1-%2 ").arg(sourceMap[i].start, 5).arg(sourceMap[i].end, -5);
+            switch (ins.op) {
+                case OpCode::ADD:
+                    info += QString("%1: ADD %2 %3\n").arg(i, 3).arg(at).arg(ins.arg);
+                    break;
+                case OpCode::MOVE:
+                    info += QString("%1: MOVE %2\n").arg(i, 3).arg(ins.arg);
+                    break;
+                case OpCode::OUTPUT:
+                    info += QString("%1: OUT %2\n").arg(i, 3).arg(at);
+                    break;
+                case OpCode::INPUT:
+                    info += QString("%1: IN %2\n").arg(i, 3).arg(at);
+                    break;
+                case OpCode::LOOP_START:
+                    info += QString("%1: [ %2\n").arg(i, 3).arg(ins.arg);
+                    break;
+                case OpCode::LOOP_END:
+                    info += QString("%1: ] %2\n").arg(i, 3).arg(ins.arg);
+                    break;
+                case OpCode::CLEAR:
+                    info += QString("%1: SET 0 (else loop until %2)\n").arg(i, 3).arg(ins.arg);
+                    break;
+                case OpCode::MULTIPLY:
+                    info += QString("%1: MUL-ADD (else loop until %2)\n").arg(i, 3).arg(ins.arg);
+                    break;
+                case OpCode::MUL_TERM:
+                    info += QString("%1:   %2 += p * %3\n").arg(i, 3).arg(at).arg(ins.arg);
+                    break;
+                case OpCode::SCAN:
+                    info += QString("%1: SCAN stride %2 (else loop until %3)\n").arg(i, 3).arg(ins.offset).arg(ins.arg);
+                    break;
+                case OpCode::BREAK:
+                    info += QString("%1: BREAK at %2\n").arg(i, 3).arg(ins.arg);
+                    break;
             }
         }
 
-        CompileOutputDialog dialog(this, "Compiled Program Analysis", info);
+        info += "\nThe C translation of this program can be exported below. Build it with\n"
+                "cc -O2 -DMB_STANDALONE program.c to get a program that reads stdin and writes stdout.\n";
+
+        CompileOutputDialog dialog(this, "Compiled Program Analysis", info,
+                                   QString::fromStdString(analysis->generateC()));
         dialog.exec();
 
     } catch (const std::exception& e) {
@@ -708,7 +1058,7 @@ void MainWindow::onCompile() {
 void MainWindow::onPseudocode() {
     std::string program = editor->toPlainText().toStdString();
     Interpreter tempInterp;
-    tempInterp.configure(settings.pointerBehavior, settings.cellBehavior);
+    tempInterp.configure(settings.pointerBehavior, settings.cellBehavior, settings.cellWidth);
     tempInterp.loadProgram(program, "");
 
     try {
@@ -727,69 +1077,94 @@ void MainWindow::onAbout() {
 }
 
 void MainWindow::loadInterpreterFromUI() {
+    stopWorker();
     std::string program = editor->toPlainText().toStdString();
     interp->reset();
     interp->loadProgram(program, "");
-    interp->configure(settings.pointerBehavior, settings.cellBehavior);
+    interp->configure(settings.pointerBehavior, settings.cellBehavior, settings.cellWidth);
     interp->setInputCallback([this]() { return requestInput(); });
     output->setPlainText("");
+    outputShown = 0;
+    opsPerSecond = 0;
 
     bool shouldHighlight = (executionMode == 0) || (!timer->isActive());
     editor->updateHighlighting(shouldHighlight ? interp->getPc() : -1);
 }
 
-bool MainWindow::executeOneStep() {
-    if (executionMode == 2) {
-        return executeFastChunk();
-    } else {
-        return executeDebugStep();
+void MainWindow::startWorker() {
+    if (runner->isActive()) {
+        return;
     }
+    // Breakpoints are compiled into the program as traps, so the worker stops on them
+    // by itself and leaves pc on the breakpoint.
+    watchVisibleCells();
+    runner->start(editor->getBreakpoints(), std::numeric_limits<int>::max(), WORKER_SLICE,
+                  std::chrono::milliseconds(timerIntervals[2]));
 }
 
-bool MainWindow::executeFastChunk() {
-    try {
-       
-        if (editor->getBreakpoints().count(interp->getPc())) {
+void MainWindow::pollWorker() {
+    if (const ExecutionSnapshot* snapshot = runner->latestSnapshot()) {
+        live = snapshot;
+        opsPerSecond = live->opsPerSecond;
+    }
+    watchVisibleCells();
+
+    switch (runner->state()) {
+        case ExecutionState::RUNNING:
+            // Until the first snapshot arrives there is nothing that is safe to draw.
+            if (live) {
+                updateUIAfterStep();
+            }
+            break;
+        case ExecutionState::WAITING_INPUT:
             timer->stop();
-            pausedAtBreakpoint = true;
-            updateButtonStates();
             updateUIAfterStep();
-            status->showMessage("Paused at breakpoint", 3000);
-            return false;
-        }
+            runner->provideInput(requestInput());
+            timer->start();
+            break;
+        default:
+            finishWorker();
+            break;
+    }
+}
 
-        bool moreNeeded = interp->runProgramFastInterruptible(50000);
+void MainWindow::stopWorker() {
+    if (runner->isActive()) {
+        runner->stop();
+        finishWorker();
+    }
+}
 
-        if (!moreNeeded) {
-            timer->stop();
-            updateButtonStates();
-        }
+// The worker has stopped on its own or was told to: take the interpreter back and
+// report why it stopped.
+void MainWindow::finishWorker() {
+    timer->stop();
+    runner->join();
+    // The worker is done writing, so the channel's cursor is exact from here on.
+    std::string rest;
+    outputShown = outputChannel->drain(rest);
+    appendOutput(rest);
+    live = nullptr;
+    pausedAtBreakpoint = runner->state() == ExecutionState::BREAKPOINT;
+    updateButtonStates();
+    updateUIAfterStep();
 
-        updateUIAfterStep();
-        return moreNeeded;
+    if (pausedAtBreakpoint) {
+        status->showMessage("Paused at breakpoint", 3000);
+    }
 
+    try {
+        runner->rethrowError();
     } catch (const PointerOverflowError& e) {
-        timer->stop();
-        pausedAtBreakpoint = false;
-        updateButtonStates();
         QMessageBox::critical(this, "Pointer Overflow", QString("Pointer overflow error: %1").arg(e.what()));
-        return false;
     } catch (const CellOverflowError& e) {
-        timer->stop();
-        pausedAtBreakpoint = false;
-        updateButtonStates();
         QMessageBox::critical(this, "Cell Overflow", QString("Cell overflow error: %1").arg(e.what()));
-        return false;
     } catch (const std::exception& e) {
-        timer->stop();
-        pausedAtBreakpoint = false;
-        updateButtonStates();
         QMessageBox::critical(this, "Runtime Error", QString("Execution error: %1").arg(e.what()));
-        return false;
     }
 }
 
-bool MainWindow::executeDebugStep() {
+bool MainWindow::executeDebugStep(bool refresh) {
     if (timer->isActive() &&
         editor->getBreakpoints().count(interp->getPc()) &&
         !pausedAtBreakpoint) {
@@ -803,7 +1178,9 @@ bool MainWindow::executeDebugStep() {
 
     try {
         bool advanced = interp->step();
-        updateUIAfterStep();
+        if (refresh || !advanced) {
+            updateUIAfterStep();
+        }
 
         if (!advanced) {
             timer->stop();
@@ -836,13 +1213,23 @@ bool MainWindow::executeDebugStep() {
 
 void MainWindow::updateUIAfterStep() {
     try {
-        QString currentOutput = QString::fromStdString(interp->getOutputBuffer());
-        if (output->toPlainText() != currentOutput) {
-            output->setPlainText(currentOutput);
-            QTextCursor cursor = output->textCursor();
-            cursor.movePosition(QTextCursor::End);
-            output->setTextCursor(cursor);
+        // While the worker runs, new output comes through the channel; otherwise straight
+        // from the interpreter. The channel is drained either way so it never holds
+        // output the pane already has.
+        std::string fresh;
+        size_t streamed = outputChannel->drain(fresh);
+        if (live) {
+            outputShown = streamed;
+        } else {
+            // Stepping back took output back: redraw the pane from what the sink keeps.
+            if (interp->getOutputCursor() < outputShown) {
+                output->setPlainText("");
+                outputShown = 0;
+            }
+            fresh.clear();
+            outputShown = interp->readOutputSince(outputShown, fresh);
         }
+        appendOutput(fresh);
     } catch (...) {
        
     }
@@ -853,7 +1240,7 @@ void MainWindow::updateUIAfterStep() {
 
         bool shouldHighlight = (executionMode != 2) || pausedAtBreakpoint || (!timer->isActive());
         if (shouldHighlight) {
-            editor->updateHighlighting(interp->getPc());
+            editor->updateHighlighting(live ? live->pc : interp->getPc());
         } else {
             editor->updateHighlighting(-1);
         }
@@ -862,12 +1249,19 @@ void MainWindow::updateUIAfterStep() {
     }
 }
 
+// Only the new text is inserted, so a tick costs the same however long the output
+// already is; the pane's maximum block count trims the oldest lines.
+void MainWindow::appendOutput(const std::string& text) {
+    if (text.empty()) {
+        return;
+    }
+    output->moveCursor(QTextCursor::End);
+    output->insertPlainText(QString::fromStdString(text));
+}
+
 void MainWindow::onTimer() {
     if (executionMode == 2) {
-        if (!executeFastChunk()) {
-            timer->stop();
-            updateButtonStates();
-        }
+        pollWorker();
     } else {
         int stepsPerTick = (executionMode == 1) ? 1 : 10;
 
@@ -878,7 +1272,9 @@ void MainWindow::onTimer() {
                 break;
             }
 
-            if (!executeDebugStep()) {
+            // Steps in between would never be painted, so only the last one of the tick
+            // refreshes the UI.
+            if (!executeDebugStep(i == stepsPerTick - 1)) {
                 break;
             }
 
@@ -890,86 +1286,41 @@ void MainWindow::onTimer() {
 }
 
 void MainWindow::refreshMemory() {
-    int center = interp->getPointer();
-    int totalRows = (interp->getMemorySize() + 15) / 16;
-    int visibleRows = std::min(32, totalRows);
-
-    int centerRow = center / 16;
-    int startRow = std::max(0, centerRow - visibleRows / 2);
-    int endRow = std::min(totalRows, startRow + visibleRows);
-
-    if (endRow - startRow < visibleRows) {
-        startRow = std::max(0, endRow - visibleRows);
-    }
-
-    memTable->setRowCount(endRow - startRow);
-
-    QStringList rowLabels;
-    for (int i = 0; i < endRow - startRow; ++i) {
-        int addr = (startRow + i) * 16;
-        rowLabels << QString("%1").arg(addr, 4, 16, QChar('0')).toUpper();
-    }
-    memTable->setVerticalHeaderLabels(rowLabels);
-
-    const auto& memory = interp->getMemory();
-
-    for (int row = 0; row < endRow - startRow; ++row) {
-        for (int col = 0; col < 16; ++col) {
-            int addr = (startRow + row) * 16 + col;
-
-            auto* item = new QTableWidgetItem();
-
-            if (addr < interp->getMemorySize()) {
-                int cellValue = memory[addr];
-
-                if (settings.cellBehavior == CellBehavior::UNLIMITED) {
-                    item->setText(QString::number(cellValue));
-                    if (cellValue < 0 || cellValue > 255) {
-                        item->setBackground(addr == center ? QColor(255, 100, 100) : QColor(255, 240, 240));
-                        item->setForeground(QColor(150, 0, 0));
-                    } else if (addr == center) {
-                        item->setBackground(QColor(0, 100, 0));
-                        item->setForeground(QColor(255, 255, 255));
-                    } else {
-                        item->setBackground(QColor(255, 255, 255));
-                        item->setForeground(QColor(0, 0, 0));
-                    }
-                } else {
-                    item->setText(QString::number(cellValue));
-                    if (addr == center) {
-                        item->setBackground(QColor(0, 100, 0));
-                        item->setForeground(QColor(255, 255, 255));
-                    } else {
-                        item->setBackground(QColor(255, 255, 255));
-                        item->setForeground(QColor(0, 0, 0));
-                    }
-                }
-            } else {
-                item->setText("--");
-                item->setBackground(QColor(240, 240, 240));
-                item->setForeground(QColor(128, 128, 128));
-            }
-
-            memTable->setItem(row, col, item);
+    // While the worker runs, everything comes from its latest snapshot.
+    memModel->refresh(live);
+    if (!live) {
+        int pointer = interp->getPointer();
+        if (pointer / MemoryModel::COLUMNS < memModel->rowCount()) {
+            memView->scrollTo(memModel->index(pointer / MemoryModel::COLUMNS, pointer % MemoryModel::COLUMNS),
+                              QAbstractItemView::EnsureVisible);
         }
     }
+}
 
-   
-    int currentRow = center / 16 - startRow;
-    if (currentRow >= 0 && currentRow < memTable->rowCount()) {
-        memTable->scrollToItem(memTable->item(currentRow, center % 16));
+// Wide enough for the largest value of the configured cell width, and all the same so
+// the grid does not jump around as values change.
+void MainWindow::sizeMemoryColumns() {
+    int digits = 3;
+    if (settings.cellBehavior == CellBehavior::UNLIMITED) {
+        digits = 11;
+    } else if (settings.cellWidth == CellWidth::BITS_16) {
+        digits = 5;
+    } else if (settings.cellWidth == CellWidth::BITS_32) {
+        digits = 10;
     }
+    int width = memView->fontMetrics().horizontalAdvance(QString(digits, QChar('0'))) + 12;
+    memView->horizontalHeader()->setMinimumSectionSize(width);
+    memView->horizontalHeader()->setDefaultSectionSize(width);
+}
 
-    memTable->resizeColumnsToContents();
-
-   
-    int maxWidth = 0;
-    for (int i = 0; i < 16; ++i) {
-        maxWidth = std::max(maxWidth, memTable->columnWidth(i));
-    }
-    for (int i = 0; i < 16; ++i) {
-        memTable->setColumnWidth(i, maxWidth);
+// Tells the worker which cells are on screen so its snapshots carry just those.
+void MainWindow::watchVisibleCells() {
+    int firstRow = std::max(0, memView->rowAt(0));
+    int lastRow = memView->rowAt(memView->viewport()->height() - 1);
+    if (lastRow < 0) {
+        lastRow = memModel->rowCount() - 1;
     }
+    runner->watch(firstRow * MemoryModel::COLUMNS, (lastRow - firstRow + 1) * MemoryModel::COLUMNS);
 }
 
 void MainWindow::updateStatus() {
@@ -978,21 +1329,32 @@ void MainWindow::updateStatus() {
 
     QStringList statusParts;
     statusParts << QString("[%1]").arg(mode);
-    statusParts << QString("pc=%1").arg(interp->getPc());
-    statusParts << QString("ptr=%1").arg(interp->getPointer());
-    statusParts << QString("mem[ptr]=%1").arg(interp->getMemory()[interp->getPointer()]);
-    statusParts << QString("running=%1").arg(interp->isRunning() ? "yes" : "no");
+    if (live) {
+        statusParts << QString("pc=%1").arg(live->pc);
+        statusParts << QString("ptr=%1").arg(live->pointer);
+        statusParts << QString("mem[ptr]=%1").arg(live->cell);
+        statusParts << "running=yes";
+    } else {
+        statusParts << QString("pc=%1").arg(interp->getPc());
+        statusParts << QString("ptr=%1").arg(interp->getPointer());
+        statusParts << QString("mem[ptr]=%1").arg(interp->getCell(interp->getPointer()));
+        statusParts << QString("running=%1").arg(interp->isRunning() ? "yes" : "no");
+    }
 
     if (pausedAtBreakpoint) {
         statusParts << "PAUSED AT BREAKPOINT";
     }
 
-    statusParts << QString("steps=%1").arg(interp->getFastSteps());
+    statusParts << QString("steps=%1").arg(live ? live->steps : interp->getFastSteps());
+    if (executionMode == 2 && opsPerSecond > 0) {
+        statusParts << QString("ops/sec=%1M").arg(opsPerSecond / 1e6, 0, 'f', 1);
+    }
 
     QMap<PointerBehavior, QString> pointerNames = {
         {PointerBehavior::CLAMP, "CLAMP"},
         {PointerBehavior::WRAP, "WRAP"},
-        {PointerBehavior::ERROR, "ERROR"}
+        {PointerBehavior::ERROR, "ERROR"},
+        {PointerBehavior::UNBOUNDED, "UNBOUNDED"}
     };
     QMap<CellBehavior, QString> cellNames = {
         {CellBehavior::WRAP, "WRAP"},
@@ -1011,7 +1373,7 @@ void MainWindow::loadSample() {
     editor->setPlainText(sample);
     interp->reset();
     interp->loadProgram(sample.toStdString(), "");
-    interp->configure(settings.pointerBehavior, settings.cellBehavior);
+    interp->configure(settings.pointerBehavior, settings.cellBehavior, settings.cellWidth);
     interp->setInputCallback([this]() { return requestInput(); });
     editor->updateHighlighting(interp->getPc());
     refreshMemory();
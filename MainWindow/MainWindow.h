@@ -4,7 +4,8 @@
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QPlainTextEdit>
 #include <QtWidgets/QPushButton>
-#include <QtWidgets/QTableWidget>
+#include <QtWidgets/QTableView>
+#include <QtWidgets/QHeaderView>
 #include <QtWidgets/QRadioButton>
 #include <QtWidgets/QButtonGroup>
 #include <QtWidgets/QStatusBar>
@@ -17,10 +18,12 @@
 #include <QtWidgets/QGroupBox>
 #include <QtWidgets/QTextEdit>
 #include <QtCore/QTimer>
+#include <QtCore/QAbstractTableModel>
 #include <QtGui/QAction>
 #include <QtGui/QTextCharFormat>
 #include <QtGui/QTextCursor>
 #include "../INTERPRETER/Interpreter.h"
+#include "../INTERPRETER/ExecutionThread.h"
 #include <set>
 
 class CodeEditor : public QPlainTextEdit {
@@ -40,6 +43,38 @@ class CodeEditor : public QPlainTextEdit {
         void toggleBreakpointAtCaret();
 };
 
+// The whole tape as rows of 16 cells. Reads the interpreter directly, or the worker's
+// latest snapshot while Fast mode runs, and only signals the cells that changed.
+class MemoryModel : public QAbstractTableModel {
+    Q_OBJECT
+
+    private:
+        Interpreter& interp;
+        const ExecutionSnapshot* live;
+        int rows;
+        int pointer;
+
+        int tapeSize() const;
+        void cellsChanged(int first, int last);
+
+    public:
+        static constexpr int COLUMNS = 16;
+        // UNBOUNDED reserves hundreds of millions of cells, more than a view can page through.
+        static constexpr int MAX_ROWS = 1 << 16;
+
+        explicit MemoryModel(Interpreter& interp, QObject* parent = nullptr);
+
+        int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+        int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+        QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+        QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+        // Picks up what changed since the last call: the worker's snapshot while it runs,
+        // nullptr once the interpreter is back with the UI.
+        void refresh(const ExecutionSnapshot* snapshot);
+        int getPointer() const { return pointer; }
+};
+
 class SettingsDialog : public QDialog {
     Q_OBJECT
 
@@ -49,9 +84,19 @@ class SettingsDialog : public QDialog {
         QRadioButton* clampRadio;
         QRadioButton* wrapRadio;
         QRadioButton* errorRadio;
+        QRadioButton* unboundedRadio;
         QRadioButton* cellWrapRadio;
         QRadioButton* cellUnlimitedRadio;
         QRadioButton* cellErrorRadio;
+        QButtonGroup* cellWidthGroup;
+        QRadioButton* width8Radio;
+        QRadioButton* width16Radio;
+        QRadioButton* width32Radio;
+        QButtonGroup* dispatchModeGroup;
+        QRadioButton* switchRadio;
+        QRadioButton* threadedRadio;
+        QRadioButton* jitRadio;
+        QRadioButton* cModuleRadio;
         QPushButton* okButton;
         QPushButton* cancelButton;
 
@@ -62,6 +107,10 @@ class SettingsDialog : public QDialog {
         void setPointerBehavior(PointerBehavior behavior);
         CellBehavior getCellBehavior() const;
         void setCellBehavior(CellBehavior behavior);
+        CellWidth getCellWidth() const;
+        void setCellWidth(CellWidth width);
+        DispatchMode getDispatchMode() const;
+        void setDispatchMode(DispatchMode mode);
 };
 
 class CompileOutputDialog : public QDialog {
@@ -73,7 +122,8 @@ class CompileOutputDialog : public QDialog {
     public:
         explicit CompileOutputDialog(QWidget* parent = nullptr,
                                    const QString& title = "Compilation Results",
-                                   const QString& content = "");
+                                   const QString& content = "",
+                                   const QString& exportSource = QString());
 };
 
 class AboutDialog : public QDialog {
@@ -87,15 +137,32 @@ class MainWindow : public QMainWindow {
     Q_OBJECT
 
     private:
+        // How long the Fast mode worker runs between looks at the pause flag.
+        static constexpr std::chrono::milliseconds WORKER_SLICE{2};
+
         std::unique_ptr<Interpreter> interp;
+        // Check and Compile use their own interpreter, which keeps its compiled program
+        // between calls, so they recompile only what was edited and never touch a run.
+        std::unique_ptr<Interpreter> analysis;
+        // Fast mode runs here; the timer then only polls it for snapshots and output.
+        std::unique_ptr<ExecutionThread> runner;
+        ChannelOutput* outputChannel;
+        // Output cursor of the last byte in the pane, see Interpreter::getOutputCursor().
+        size_t outputShown;
+        const ExecutionSnapshot* live;
+        // Rate of the last Fast run, for the status bar.
+        double opsPerSecond;
         QTimer* timer;
 
         CodeEditor* editor;
         QPlainTextEdit* output;
-        QTableWidget* memTable;
+        QTableView* memView;
+        MemoryModel* memModel;
 
         QPushButton* btnRun;
         QPushButton* btnStep;
+        QPushButton* btnStepBack;
+        QPushButton* btnRunBack;
         QPushButton* btnPause;
         QPushButton* btnResume;
         QPushButton* btnReset;
@@ -120,6 +187,8 @@ class MainWindow : public QMainWindow {
         struct Settings {
             PointerBehavior pointerBehavior = PointerBehavior::CLAMP;
             CellBehavior cellBehavior = CellBehavior::WRAP;
+            CellWidth cellWidth = CellWidth::BITS_8;
+            DispatchMode dispatchMode = DispatchMode::THREADED;
         } settings;
 
         int executionMode;
@@ -129,11 +198,16 @@ class MainWindow : public QMainWindow {
         void buildUI();
         void connectActions();
         void loadInterpreterFromUI();
-        bool executeOneStep();
-        bool executeFastChunk();
-        bool executeDebugStep();
+        void startWorker();
+        void pollWorker();
+        void stopWorker();
+        void finishWorker();
+        bool executeDebugStep(bool refresh = true);
         void updateUIAfterStep();
+        void appendOutput(const std::string& text);
         void refreshMemory();
+        void sizeMemoryColumns();
+        void watchVisibleCells();
         void updateStatus();
         void updateButtonStates();
         void loadSample();
@@ -145,6 +219,8 @@ class MainWindow : public QMainWindow {
         void onModeChanged();
         void onRun();
         void onStep();
+        void onStepBack();
+        void onRunBack();
         void onPause();
         void onResume();
         void onReset();
@@ -0,0 +1,31 @@
+#include "../INTERPRETER/Interpreter.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <string_view>
+
+// Prints the C that "Export C Source" would save for a program: export_c POINTER program.bf
+int main(int argc, char* argv[]) {
+    static const std::map<std::string, PointerBehavior> pointers = {
+        {"clamp", PointerBehavior::CLAMP},
+        {"wrap", PointerBehavior::WRAP},
+        {"error", PointerBehavior::ERROR},
+        {"unbounded", PointerBehavior::UNBOUNDED}
+    };
+    auto pointer = argc == 3 ? pointers.find(argv[1]) : pointers.end();
+    std::ifstream file(argc == 3 ? argv[2] : "", std::ios::binary);
+    if (pointer == pointers.end() || !file) {
+        std::cerr << "usage: export_c clamp|wrap|error|unbounded program.bf\n";
+        return 2;
+    }
+    std::string program(std::istreambuf_iterator<char>(file), {});
+    std::erase_if(program, [](char c) { return std::string_view("[].,<>+-").find(c) == std::string_view::npos; });
+
+    Interpreter interp;
+    interp.configure(pointer->second, CellBehavior::WRAP);
+    interp.loadProgram(program);
+    std::cout << interp.generateC();
+    return 0;
+}
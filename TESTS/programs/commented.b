@@ -0,0 +1,2 @@
+Prints A: eight times eight plus one
+++++++++[>++++++++<-]>+.
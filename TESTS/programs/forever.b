@@ -0,0 +1,2 @@
+Loops forever
++[]
\ No newline at end of file
@@ -0,0 +1,2 @@
+Walks off the left edge then prints 1: the cell it lands on is counted up to 49
+<<<+++++++++++++++++++++++++++++++++++++++++++++++++.
@@ -0,0 +1,2 @@
+Two steps once folded: add 65 then print A
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.
\ No newline at end of file
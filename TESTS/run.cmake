@@ -0,0 +1,13 @@
+# Runs RUNNER with RUNNER_ARGS ("|"-separated) on PROGRAM and compares its output and
+# exit status with EXPECTED_OUTPUT and EXPECTED_STATUS.
+string(REPLACE "|" ";" args "${RUNNER_ARGS}")
+execute_process(COMMAND ${RUNNER} ${args} ${PROGRAM}
+        INPUT_FILE /dev/null
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors
+        RESULT_VARIABLE status)
+
+if(NOT output STREQUAL EXPECTED_OUTPUT OR NOT status STREQUAL EXPECTED_STATUS)
+    message(FATAL_ERROR "${PROGRAM}: expected '${EXPECTED_OUTPUT}' (status ${EXPECTED_STATUS}), "
+            "got '${output}' (status ${status})\n${errors}")
+endif()
@@ -0,0 +1,26 @@
+# Exports PROGRAM as C with EXPORTER for POINTER, builds it standalone with C_COMPILER in
+# WORK_DIR and checks that it prints EXPECTED_OUTPUT and exits 0, like the interpreter.
+file(MAKE_DIRECTORY ${WORK_DIR})
+execute_process(COMMAND ${EXPORTER} ${POINTER} ${PROGRAM}
+        OUTPUT_FILE ${WORK_DIR}/exported.c
+        RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "exporting ${PROGRAM} failed (status ${status})")
+endif()
+
+execute_process(COMMAND ${C_COMPILER} -O1 -DMB_STANDALONE -o ${WORK_DIR}/exported ${WORK_DIR}/exported.c
+        ERROR_VARIABLE errors
+        RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "building the exported C failed:\n${errors}")
+endif()
+
+execute_process(COMMAND ${WORK_DIR}/exported
+        INPUT_FILE /dev/null
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors
+        RESULT_VARIABLE status)
+if(NOT output STREQUAL EXPECTED_OUTPUT OR NOT status EQUAL 0)
+    message(FATAL_ERROR "exported ${PROGRAM} (${POINTER}): expected '${EXPECTED_OUTPUT}' (status 0), "
+            "got '${output}' (status ${status})\n${errors}")
+endif()